@@ -0,0 +1,467 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "chip.h"
+#include "aot.h"
+
+/*
+	Chip ahead of time compiler
+
+	translates a compiled chip file into a standalone c file with one
+	function per method. ops become the same statements eval() runs on
+	the same stack, jumps become gotos and a call is a c call, so the
+	result links against runtime.c and heap.c only:
+
+	$ gcc -O2 -Isrc a.out.c src/runtime.c src/heap.c -o program -lm -pthread
+*/
+
+/* filled in by load_file() */
+extern char        *constant_pool;
+extern int64_t      constant_count;
+extern int64_t      constant_pool_size;
+extern Instruction *codes;
+extern int          code_size;
+extern Method      *methods;
+extern int          method_count;
+
+/* the method being written allocates from the frame region */
+static bool aot_region = false;
+
+/* c operator of each integer stack op */
+static const char *aot_operator(uint8_t op) {
+	switch(op) {
+		case OP_CMPEQ: {
+			return "==";
+		}
+		break;
+		case OP_CMPGT: {
+			return ">";
+		}
+		break;
+		case OP_CMPLT: {
+			return "<";
+		}
+		break;
+		case OP_SHR: {
+			return ">>";
+		}
+		break;
+		case OP_SHL: {
+			return "<<";
+		}
+		break;
+		case OP_ADD: {
+			return "+";
+		}
+		break;
+		case OP_SUB: {
+			return "-";
+		}
+		break;
+		case OP_MUL: {
+			return "*";
+		}
+		break;
+		case OP_DIV: {
+			return "/";
+		}
+		break;
+		case OP_MOD: {
+			return "%";
+		}
+		break;
+		case OP_OR: {
+			return "|";
+		}
+		break;
+		case OP_XOR: {
+			return "^";
+		}
+		break;
+		case OP_AND: {
+			return "&";
+		}
+		break;
+		case OP_FADD: {
+			return "+";
+		}
+		break;
+		case OP_FSUB: {
+			return "-";
+		}
+		break;
+		case OP_FMUL: {
+			return "*";
+		}
+		break;
+		case OP_FDIV: {
+			return "/";
+		}
+		break;
+	}
+	return NULL;
+}
+
+/* the base stack op of each register op, mov and movi have none */
+#undef DEFINE_REGISTER_OP
+#define DEFINE_OP(name, display, oprands, pops, pushes)
+#define DEFINE_REGISTER_OP(name, display) OP_##name, OP_##name,
+static uint8_t register_base_op[] = {
+	LIST_OF_REGISTER_OPS
+};
+#undef DEFINE_OP
+#undef DEFINE_REGISTER_OP
+
+/* the pool as it is in the file, it is used in place like any other */
+static void aot_pool(FILE *out) {
+	fprintf(out, "static _Alignas(%i) char constant_pool[%li] = {", CONST_ALIGN, constant_pool_size + 1);
+	for(int64_t i = 0; i < constant_pool_size; i++) {
+		fprintf(out, "%s%i,", i % 16 ? " " : "\n\t", (unsigned char)constant_pool[i]);
+	}
+	fprintf(out, "\n\t0\n};\n\n");
+}
+
+/*
+	writes the c statement of one op of caller, jumps go to the L<pc> 
+	labels of the function
+*/
+
+static void aot_op(FILE *out, Method *caller, Instruction *ins, int pc) {
+	uint8_t op   = ins->op;
+	int64_t left = ins->left;
+
+	if(op >= OP_LOAD_0 && op <= OP_LOAD_5) {
+		op   = OP_LOAD;
+		left = ins->op - OP_LOAD_0;
+	} else if(op >= OP_STORE_0 && op <= OP_STORE_5) {
+		op   = OP_STORE;
+		left = ins->op - OP_STORE_0;
+	} else if(op >= OP_PUSH_0 && op <= OP_PUSH_5) {
+		op   = OP_PUSH;
+		left = ins->op - OP_PUSH_0;
+	}
+
+	fprintf(out, "\t/* %s */ ", op_display[ins->op]);
+
+	if(op >= OP_ADD_RR && op <= OP_CMPLT_RI) {
+		const char *operator = aot_operator(register_base_op[op - OP_ADD_RR]);
+		bool immediate = (op - OP_ADD_RR) % 2 == 1;
+
+		if(immediate) {
+			fprintf(out, "SET_VAR_SLOT(%i, ((Slot){ .is_ref = false, .value = GET_VAR_SLOT(%i).value %s (int64_t)0x%lxull }));\n", ins->dest, ins->right, operator, left);
+		} else {
+			fprintf(out, "SET_VAR_SLOT(%i, ((Slot){ .is_ref = false, .value = GET_VAR_SLOT(%i).value %s GET_VAR_SLOT(%li).value }));\n", ins->dest, ins->right, operator, left);
+		}
+		return;
+	}
+
+	switch(op) {
+		case OP_NOP: {
+			fprintf(out, ";\n");
+		}
+		break;
+		/*
+			locals are copied field by field, that lets gcc keep them in 
+			registers and avoids a 16 byte load of a slot just written 
+			through its value
+		*/
+		case OP_LOAD: {
+			fprintf(out, "{ stack[sp].is_ref = GET_VAR_SLOT(%li).is_ref; stack[sp].value = GET_VAR_SLOT(%li).value; INC_STACK(); }\n", left, left);
+		}
+		break;
+		case OP_STORE: {
+			fprintf(out, "{ DEC_STACK(); GET_VAR_SLOT(%li).is_ref = stack[sp].is_ref; GET_VAR_SLOT(%li).value = stack[sp].value; stack[sp].is_ref = false; }\n", left, left);
+		}
+		break;
+		case OP_DUP: {
+			fprintf(out, "{ Slot s = TOP_STACK_SLOT(); PUSH_STACK_SLOT(s); }\n");
+		}
+		break;
+		case OP_PUSH: {
+			fprintf(out, "PUSH_STACK((int64_t)0x%lxull);\n", left);
+		}
+		break;
+		case OP_POP: {
+			fprintf(out, "POP_STACK_OBJECT();\n");
+		}
+		break;
+		case OP_LOAD_CONST: {
+			fprintf(out, "{ SYNC_ROOTS(); Object *o = runtime_load_const(%li); PUSH_STACK_OBJECT(o); }\n", left);
+		}
+		break;
+		case OP_LOAD_CONST_SHARED: {
+			fprintf(out, "PUSH_STACK_SLOT(((Slot){ .is_ref = false, .ref = constant_objects[%li] }));\n", left);
+		}
+		break;
+		case OP_LOAD_FIELD: {
+			fprintf(out, "{ Object *instance = POP_STACK_OBJECT(); Slot var = OBJECT_VARLIST(instance)[%li]; PUSH_STACK_SLOT(var); }\n", left);
+		}
+		break;
+		case OP_STORE_FIELD: {
+			fprintf(out, "{ Object *instance = POP_STACK_OBJECT(); Slot var = POP_STACK_SLOT(); runtime_store_field(instance, %li, var); }\n", left);
+		}
+		break;
+		case OP_CMPEQ:
+		case OP_CMPGT:
+		case OP_CMPLT:
+		case OP_SHR:
+		case OP_SHL:
+		case OP_ADD:
+		case OP_SUB:
+		case OP_MUL:
+		case OP_DIV:
+		case OP_MOD:
+		case OP_OR:
+		case OP_XOR:
+		case OP_AND: {
+			fprintf(out, "{ int64_t a = POP_STACK(); int64_t b = POP_STACK(); PUSH_STACK(b %s a); }\n", aot_operator(op));
+		}
+		break;
+		case OP_NEG: {
+			fprintf(out, "{ int64_t a = POP_STACK(); PUSH_STACK(-a); }\n");
+		}
+		break;
+		case OP_NOT: {
+			fprintf(out, "{ int64_t a = POP_STACK(); PUSH_STACK(~a); }\n");
+		}
+		break;
+		case OP_FADD:
+		case OP_FSUB:
+		case OP_FMUL:
+		case OP_FDIV: {
+			fprintf(out, "{ double a = POP_STACK_DOUBLE(); double b = POP_STACK_DOUBLE(); PUSH_STACK_DOUBLE(b %s a); }\n", aot_operator(op));
+		}
+		break;
+		case OP_FNEG: {
+			fprintf(out, "{ double a = POP_STACK_DOUBLE(); PUSH_STACK_DOUBLE(-a); }\n");
+		}
+		break;
+		case OP_FMOD: {
+			fprintf(out, "{ double a = POP_STACK_DOUBLE(); double b = POP_STACK_DOUBLE(); PUSH_STACK_DOUBLE(fmod(a, b)); }\n");
+		}
+		break;
+		case OP_I2F: {
+			fprintf(out, "{ int64_t a = POP_STACK(); PUSH_STACK_DOUBLE((double)a); }\n");
+		}
+		break;
+		case OP_CALL: {
+			Method *method = &methods[ins->right];
+
+			fprintf(out, "{\n");
+			fprintf(out, "\t\tif(sp - %i + %i > STACK_MAX) {\n", method->arg_count + 1, method->max_stack);
+			fprintf(out, "\t\t\tprintf(\"stackoverflow, sp = %%li\\n\", sp);\n");
+			fprintf(out, "\t\t\texit(1);\n");
+			fprintf(out, "\t\t}\n");
+			fprintf(out, "\t\tif(vp + %i + %i > STACK_BASE) {\n", caller->locals, method->locals);
+			fprintf(out, "\t\t\tprintf(\"frameoverflow, vp = %%li\\n\", vp);\n");
+			fprintf(out, "\t\t\texit(1);\n");
+			fprintf(out, "\t\t}\n");
+			fprintf(out, "\t\tsp = runtime_call(stack, vp + %i, sp, %i, %i);\n", caller->locals, method->arg_count + 1, method->locals);
+			fprintf(out, "\t\tsp = method_%li(vp + %i, sp);\n", left, caller->locals);
+			fprintf(out, "\t}\n");
+		}
+		break;
+		case OP_SYSCALL: {
+			fprintf(out, "SYNC_ROOTS(); sp = runtime_syscall(stack, sp);\n");
+		}
+		break;
+		case OP_ALLOC: {
+			fprintf(out, "{ SYNC_ROOTS(); Object *o = new_object(%i); o->type = sizeof(o); PUSH_STACK_OBJECT(o); }\n", (int)left);
+		}
+		break;
+		case OP_NEW_ARRAY: {
+			fprintf(out, "{ SYNC_ROOTS(); int64_t count = POP_STACK(); Object *instance = runtime_new_array(count, %i); PUSH_STACK_OBJECT(instance); }\n", (int8_t)left);
+		}
+		break;
+		case OP_NEW_LOCAL_ARRAY: {
+			fprintf(out, "{ SYNC_ROOTS(); int64_t count = POP_STACK(); PUSH_STACK_SLOT(runtime_new_local_array(count, %i)); }\n", (int8_t)left);
+		}
+		break;
+		case OP_NEW_REF_ARRAY: {
+			fprintf(out, "{ SYNC_ROOTS(); int64_t count = POP_STACK(); Object *instance = runtime_new_array(count, %i); instance->has_refs = true; PUSH_STACK_OBJECT(instance); }\n", (int8_t)left);
+		}
+		break;
+		case OP_LOAD_ARRAY_I8: {
+			fprintf(out, "{ int64_t index = POP_STACK(); Object *instance = POP_STACK_OBJECT(); PUSH_STACK(runtime_load_i8(instance, index)); }\n");
+		}
+		break;
+		case OP_LOAD_ARRAY_I64: {
+			fprintf(out, "{ int64_t index = POP_STACK(); Object *instance = POP_STACK_OBJECT(); PUSH_STACK_SLOT(runtime_load_i64(instance, index)); }\n");
+		}
+		break;
+		case OP_STORE_ARRAY_I8: {
+			fprintf(out, "{ int64_t index = POP_STACK(); Object *instance = POP_STACK_OBJECT(); int64_t value = POP_STACK(); runtime_store_i8(instance, index, value); }\n");
+		}
+		break;
+		case OP_STORE_ARRAY_I64: {
+			fprintf(out, "{ int64_t index = POP_STACK(); Object *instance = POP_STACK_OBJECT(); int64_t value = POP_STACK(); runtime_store_i64(instance, index, value); }\n");
+		}
+		break;
+		case OP_LOAD_ARRAY_I8_U: {
+			fprintf(out, "{ int64_t index = POP_STACK(); Object *instance = POP_STACK_OBJECT(); PUSH_STACK(runtime_load_i8_unchecked(instance, index)); }\n");
+		}
+		break;
+		case OP_LOAD_ARRAY_I64_U: {
+			fprintf(out, "{ int64_t index = POP_STACK(); Object *instance = POP_STACK_OBJECT(); PUSH_STACK_SLOT(runtime_load_i64_unchecked(instance, index)); }\n");
+		}
+		break;
+		case OP_STORE_ARRAY_I8_U: {
+			fprintf(out, "{ int64_t index = POP_STACK(); Object *instance = POP_STACK_OBJECT(); int64_t value = POP_STACK(); runtime_store_i8_unchecked(instance, index, value); }\n");
+		}
+		break;
+		case OP_STORE_ARRAY_I64_U: {
+			fprintf(out, "{ int64_t index = POP_STACK(); Object *instance = POP_STACK_OBJECT(); int64_t value = POP_STACK(); runtime_store_i64_unchecked(instance, index, value); }\n");
+		}
+		break;
+		case OP_JE: {
+			fprintf(out, "{ int64_t a = POP_STACK(); int64_t b = POP_STACK(); if(a == b) goto L%li; }\n", left);
+		}
+		break;
+		case OP_JMP: {
+			fprintf(out, "goto L%li;\n", left);
+		}
+		break;
+		case OP_RET: {
+			if(aot_region) {
+				fprintf(out, "{ local_top = local_mark; return sp; }\n");
+			} else {
+				fprintf(out, "return sp;\n");
+			}
+		}
+		break;
+		case OP_HALT: {
+			fprintf(out, "{ int64_t ret_code = POP_STACK(); exit(ret_code); }\n");
+		}
+		break;
+		case OP_MOV: {
+			fprintf(out, "SET_VAR_SLOT(%i, GET_VAR_SLOT(%li));\n", ins->dest, left);
+		}
+		break;
+		case OP_MOVI: {
+			fprintf(out, "SET_VAR_SLOT(%i, ((Slot){ .is_ref = false, .value = (int64_t)0x%lxull }));\n", ins->dest, left);
+		}
+		break;
+		case OP_INC_LOCAL: {
+			fprintf(out, "GET_VAR_SLOT(%i).value += (int64_t)0x%lxull; GET_VAR_SLOT(%i).is_ref = false;\n", ins->right, left, ins->right);
+		}
+		break;
+		case OP_JZ: {
+			fprintf(out, "{ int64_t a = POP_STACK(); if(a == 0) goto L%li; }\n", left);
+		}
+		break;
+		case OP_JZ_LOCAL: {
+			fprintf(out, "if(GET_VAR_SLOT(%i).value == 0) goto L%li;\n", ins->right, left);
+		}
+		break;
+		case OP_CMPEQ_JZ:
+		case OP_CMPGT_JZ:
+		case OP_CMPLT_JZ: {
+			uint8_t compare = op == OP_CMPEQ_JZ ? OP_CMPEQ : op == OP_CMPGT_JZ ? OP_CMPGT : OP_CMPLT;
+			fprintf(out, "{ int64_t a = POP_STACK(); int64_t b = POP_STACK(); if(!(b %s a)) goto L%li; }\n", aot_operator(compare), left);
+		}
+		break;
+		default: {
+			printf("aot: unsupported instruction %s at %i\n", op_display[ins->op], pc);
+			exit(1);
+		}
+		break;
+	}
+}
+
+static int aot_compare_entry(const void *a, const void *b) {
+	return methods[*(const int*)a].entry - methods[*(const int*)b].entry;
+}
+
+void aot(const char *input, const char *output) {
+	int entry = load_file(input);
+
+	FILE *out = fopen(output, "w");
+	if(!out) {
+		printf("unable to open %s\n", output);
+		exit(1);
+	}
+
+	/* methods are laid out one after another, each runs up to the next */
+	int *order = malloc(sizeof(int) * method_count);
+	for(int m = 0; m < method_count; m++) {
+		order[m] = m;
+	}
+	qsort(order, method_count, sizeof(int), aot_compare_entry);
+
+	bool *target = calloc(code_size, sizeof(bool));
+	for(int i = 0; i < code_size; i++) {
+		if(op_is_jump(codes[i].op) && codes[i].op != OP_CALL) {
+			target[codes[i].left] = true;
+		}
+	}
+
+	fprintf(out, "/* generated by chip aot from %s */\n\n", input);
+	fprintf(out, "#include <stdlib.h>\n");
+	fprintf(out, "#include <stdio.h>\n");
+	fprintf(out, "#include <math.h>\n");
+	fprintf(out, "#include <signal.h>\n");
+	fprintf(out, "#include <time.h>\n");
+	fprintf(out, "#include \"runtime.h\"\n\n");
+
+	aot_pool(out);
+
+	fprintf(out, "static Slot *stack;\n\n");
+
+	for(int m = 0; m < method_count; m++) {
+		fprintf(out, "static int64_t method_%i(int64_t vp, int64_t sp);\n", methods[order[m]].entry);
+	}
+
+	for(int m = 0; m < method_count; m++) {
+		int start = methods[order[m]].entry;
+		int end   = m + 1 < method_count ? methods[order[m + 1]].entry : code_size;
+
+		fprintf(out, "\nstatic int64_t method_%i(int64_t vp, int64_t sp) {\n", start);
+
+		/* what the method takes from the frame region is freed when it returns */
+		aot_region = false;
+		for(int pc = start; pc < end; pc++) {
+			aot_region |= codes[pc].op == OP_NEW_LOCAL_ARRAY;
+		}
+		if(aot_region) {
+			fprintf(out, "\tchar *local_mark = local_top;\n");
+		}
+
+		for(int pc = start; pc < end; pc++) {
+			Instruction *ins = &codes[pc];
+
+			if(op_is_jump(ins->op) && ins->op != OP_CALL && (ins->left < start || ins->left >= end)) {
+				printf("aot: jump out of method at %i\n", pc);
+				exit(1);
+			}
+
+			if(target[pc]) {
+				fprintf(out, "L%i:\n", pc);
+			}
+
+			aot_op(out, &methods[order[m]], ins, pc);
+		}
+
+		if(aot_region) {
+			fprintf(out, "\tlocal_top = local_mark;\n");
+		}
+		fprintf(out, "\treturn sp;\n");
+		fprintf(out, "}\n");
+	}
+
+	fprintf(out, "\nint main() {\n");
+	fprintf(out, "\tsrand(time(NULL));\n");
+	fprintf(out, "\tsignal(SIGPIPE, SIG_IGN);\n");
+	fprintf(out, "\tstack = runtime_stack();\n");
+	fprintf(out, "\truntime_constants(constant_pool, %li);\n", constant_count);
+	fprintf(out, "\truntime_enter(stack, 0, %i);\n\n", methods[0].locals);
+	fprintf(out, "\tmethod_%i(0, STACK_BASE);\n\n", entry);
+	fprintf(out, "\treturn 0;\n");
+	fprintf(out, "}\n");
+
+	fclose(out);
+
+	free(order);
+	free(target);
+
+	printf("wrote %s\n", output);
+}
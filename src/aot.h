@@ -0,0 +1,9 @@
+#ifndef AOT_H
+#define AOT_H
+
+#include "intepreter.h"
+#include "verify.h"
+
+void              aot(const char *input, const char *output);
+
+#endif
@@ -0,0 +1,291 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "bounds.h"
+
+/*
+	Chip bounds check elimination
+
+	in a counted loop
+
+		for(int i = n; i < a.count; i = i + k) { ... a[i] ... }
+
+	with constants n and k of at least zero, or the same loop as a
+	while right after i = n, every a[i] of the body that runs before
+	anything could change i or a is in bounds: the condition just held
+	and i never drops below zero. a count fits in 32 bits, so with k
+	at most INT32_MAX i + k can not overflow past the condition. a is a local or a field of one, the
+	field can also change in any call. such accesses are marked
+	in_bounds and codegen gives them the unchecked array ops
+*/
+
+typedef struct {
+	int   index;      /* slot of i */
+	Node *array;      /* a */
+	int   base;       /* slot of a or of the object a is a field of */
+	bool  mark;       /* mark accesses or only look for changes */
+	bool  killed;     /* i or a may have changed in this iteration */
+	bool  broken;     /* i is set to something else than i + k */
+} Loop;
+
+static void bounds_walk(Node *node, Loop *loop);
+
+static bool bounds_constant(Node *node) {
+	return node && node->type == ND_NUMBER && atol(node->token->data) >= 0;
+}
+
+static bool bounds_variable(Node *node, int slot) {
+	return node && node->type == ND_VARIABLE && node->offset == slot && !type_get(node->token->data);
+}
+
+/* a local or a field of one */
+static bool bounds_array(Node *node) {
+	if(node->type == ND_VARIABLE) {
+		return bounds_variable(node, node->offset);
+	}
+	return node->type == ND_MEMBER && node->body && bounds_variable(node->body, node->body->offset);
+}
+
+static bool bounds_same(Node *a, Node *b) {
+	if(a->type != b->type || a->offset != b->offset) {
+		return false;
+	}
+	return a->type == ND_VARIABLE ? bounds_variable(a, b->offset) : bounds_variable(a->body, b->body->offset);
+}
+
+/* i = n, as a declaration or a statement, gives the slot of i or -1 */
+static int bounds_start(Node *node) {
+	if(!node || (node->type != ND_DECL && node->type != ND_EXPR) || !node->body) {
+		return -1;
+	}
+
+	Node *assign = node->body;
+	if(assign->type != ND_ASSIGN || assign->left->type != ND_VARIABLE || !bounds_constant(assign->right)) {
+		return -1;
+	}
+
+	return assign->left->offset;
+}
+
+/* a constant step small enough that i + k stays positive for any i below a count */
+static bool bounds_increment(Node *node) {
+	return bounds_constant(node) && strtoll(node->token->data, NULL, 10) <= INT32_MAX;
+}
+
+/* i = i + k */
+static bool bounds_step(Node *node, int slot) {
+	if(node->type != ND_ASSIGN || !bounds_variable(node->left, slot) || node->right->type != ND_ADD) {
+		return false;
+	}
+
+	Node *add = node->right;
+	return (bounds_variable(add->left, slot) && bounds_increment(add->right)) ||
+		(bounds_variable(add->right, slot) && bounds_increment(add->left));
+}
+
+static void bounds_list(List *list, Loop *loop, bool reverse) {
+	if(reverse) {
+		for(ListNode *it = list_back(list); it != list_end(list); it = list_previous(it)) {
+			bounds_walk((Node*)it, loop);
+		}
+	} else {
+		for(ListNode *it = list_begin(list); it != list_end(list); it = list_next(it)) {
+			bounds_walk((Node*)it, loop);
+		}
+	}
+}
+
+/* code that could store into the field a is */
+static void bounds_call(Loop *loop) {
+	if(loop->array->type == ND_MEMBER) {
+		loop->killed = true;
+	}
+}
+
+static void bounds_access(Node *node, Loop *loop) {
+	if(loop->mark && !loop->killed && bounds_variable(node->index, loop->index) && bounds_same(node->body, loop->array)) {
+		node->in_bounds = true;
+	}
+}
+
+/*
+	follows the order codegen evaluates in, an access is only marked
+	while nothing before it in the iteration could have changed i or a
+*/
+
+static void bounds_walk(Node *node, Loop *loop) {
+	if(!node) {
+		return;
+	}
+
+	switch(node->type) {
+		case ND_ASSIGN: {
+			bounds_walk(node->right, loop);
+
+			Node *left = node->left;
+			if(left->type == ND_VARIABLE) {
+				if(left->offset == loop->index) {
+					loop->broken |= !bounds_step(node, loop->index);
+					loop->killed  = true;
+				}
+				if(left->offset == loop->base) {
+					loop->killed = true;
+				}
+			} else if(left->type == ND_ARRAYMEMBER) {
+				bounds_walk(left->body, loop);
+				bounds_walk(left->index, loop);
+				bounds_access(left, loop);
+			} else {
+				bounds_walk(left->body, loop);
+				if(loop->array->type == ND_MEMBER && left->offset == loop->array->offset) {
+					loop->killed = true;
+				}
+			}
+		}
+		break;
+		case ND_ARRAYMEMBER: {
+			bounds_walk(node->body, loop);
+			bounds_walk(node->index, loop);
+			bounds_access(node, loop);
+		}
+		break;
+		case ND_CALL: {
+			bounds_walk(node->body, loop);
+			bounds_walk(node->args, loop);
+			bounds_call(loop);
+		}
+		break;
+		case ND_NEW: {
+			bounds_walk(node->args, loop);
+			if(node->method) {
+				bounds_call(loop);
+			}
+		}
+		break;
+		case ND_ARG: {
+			/* arguments are pushed last to first */
+			bounds_list(&node->bodylist, loop, true);
+		}
+		break;
+		case ND_BLOCK: {
+			bounds_list(&node->bodylist, loop, false);
+		}
+		break;
+		case ND_IF: {
+			bounds_walk(node->condition, loop);
+
+			bool killed = loop->killed;
+			bounds_walk(node->body, loop);
+
+			bool body_killed = loop->killed;
+			loop->killed = killed;
+			bounds_walk(node->alternate, loop);
+
+			loop->killed |= body_killed;
+		}
+		break;
+		case ND_WHILE:
+		case ND_FOR: {
+			bounds_walk(node->init, loop);
+
+			/* an inner loop runs its body again after any change in it */
+			Loop inner = *loop;
+			inner.mark = false;
+			bounds_walk(node->condition, &inner);
+			bounds_walk(node->body, &inner);
+			bounds_walk(node->increment, &inner);
+
+			loop->killed |= inner.killed;
+			loop->broken |= inner.broken;
+
+			bounds_walk(node->condition, loop);
+			bounds_walk(node->body, loop);
+			bounds_walk(node->increment, loop);
+		}
+		break;
+		default: {
+			bounds_walk(node->left, loop);
+			bounds_walk(node->right, loop);
+			bounds_walk(node->body, loop);
+			bounds_walk(node->args, loop);
+		}
+		break;
+	}
+}
+
+/* start is the slot the statement before the loop set to n or -1 */
+static void bounds_loop(Node *node, int start) {
+	Node *condition = node->condition;
+	if(condition->type != ND_LT || !bounds_variable(condition->left, start)) {
+		return;
+	}
+
+	Node *count = condition->right;
+	if(count->type != ND_MEMBER || strcmp(count->token->data, "count") || !bounds_array(count->body)) {
+		return;
+	}
+
+	/* only arrays have count as a primitive */
+	if(count->body->ty != type_get("int") && count->body->ty != type_get("char")) {
+		return;
+	}
+
+	if(node->increment && !bounds_step(node->increment, start)) {
+		return;
+	}
+
+	Loop loop = {
+		.index  = start,
+		.array  = count->body,
+		.base   = count->body->type == ND_VARIABLE ? count->body->offset : count->body->body->offset,
+		.mark   = false,
+		.killed = false,
+		.broken = false
+	};
+
+	bounds_walk(node->body, &loop);
+	if(loop.broken) {
+		return;
+	}
+
+	loop.mark   = true;
+	loop.killed = false;
+	bounds_walk(node->body, &loop);
+}
+
+static void bounds_visit(Node *node, Node *previous) {
+	if(!node) {
+		return;
+	}
+
+	switch(node->type) {
+		case ND_METHOD:
+		case ND_BLOCK: {
+			previous = NULL;
+			for(ListNode *it = list_begin(&node->bodylist); it != list_end(&node->bodylist); it = list_next(it)) {
+				bounds_visit((Node*)it, previous);
+				previous = (Node*)it;
+			}
+		}
+		break;
+		case ND_IF: {
+			bounds_visit(node->body, NULL);
+			bounds_visit(node->alternate, NULL);
+		}
+		break;
+		case ND_WHILE: {
+			bounds_loop(node, bounds_start(previous));
+			bounds_visit(node->body, NULL);
+		}
+		break;
+		case ND_FOR: {
+			bounds_loop(node, bounds_start(node->init));
+			bounds_visit(node->body, NULL);
+		}
+		break;
+	}
+}
+
+void bounds(Node *method) {
+	bounds_visit(method, NULL);
+}
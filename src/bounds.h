@@ -0,0 +1,8 @@
+#ifndef BOUNDS_H
+#define BOUNDS_H
+
+#include "parse.h"
+
+void              bounds(Node *method);
+
+#endif
@@ -7,7 +7,30 @@
 #include <stdbool.h>
 #include <stddef.h>
 
-#define CHIP_VERSION 0x00000001
+#define CHIP_VERSION 0x00000004
+#define CHIP_MAGIC "\177CHIP"
+
+/*
+	the constant pool follows the code at the next CONST_PAGE bytes of 
+	the file, so writing the pages it is mapped to leaves those of the 
+	code alone (see load_file()). it starts with the big endian offset 
+	of each constant from the start of the pool, then come the 
+	constants, each at a CONST_ALIGN boundary:
+
+		16 bytes    zero, room for the object header
+		8 bytes     big endian length
+		8 bytes     zero
+		the bytes of the constant, a 0 and zeros up to the boundary
+
+	every constant is laid out as the array object it becomes, so the 
+	pool is used in place (see runtime_constants())
+*/
+
+#define CONST_ALIGN 16
+#define CONST_PAGE 4096
+#define CONST_HEADER 32
+#define CONST_ROUND(x) (((x) + CONST_ALIGN - 1) & ~(int64_t)(CONST_ALIGN - 1))
+#define CONST_PAGE_ROUND(x) (((x) + CONST_PAGE - 1) & ~(int64_t)(CONST_PAGE - 1))
 
 #if __BIG_ENDIAN__
 # define HTONS(x) (x)
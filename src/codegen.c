@@ -4,6 +4,8 @@
 #include <unistd.h>
 #include "chip.h"
 #include "optimize.h"
+#include "bounds.h"
+#include "escape.h"
 #include "codegen.h"
 
 static Label labels[8192] = {};
@@ -19,40 +21,63 @@ static int rand_string() {
     return result++;
 }
 
-int line2addr(int line) {
-	int addr = 0;
-	for(int i = 0; i < code_counter; i++) {
-		Op *current = codes[i];
+int op_encoded_size(Op *ins) {
+	int oprands = op_size[ins->op];
+	int size    = 1;
 
-		if(i == line) {
-			return addr;
-		}
+	if(oprands > 0) {
+		size += 1; // widths
+		size += 1 << ins->width;
+	}
+	if(oprands > 1) {
+		size += 1 << closest_container_size(ins->right);
+	}
+	if(oprands > 2) {
+		size += 1 << closest_container_size(ins->dest);
+	}
 
-		uint8_t op    = current->op;
-		int64_t left  = current->left;
-		uint8_t width = current->width;
+	return size;
+}
 
-		addr++;
-		if(op_size[op]) {
-			addr += (1 << width);
-		}
+/* address of each op and the one after the last, see emit_addresses() */
+static int addresses[sizeof(codes) / sizeof(codes[0]) + 1] = {};
+
+static void emit_addresses() {
+	addresses[0] = 0;
+	for(int i = 0; i < code_counter; i++) {
+		addresses[i + 1] = addresses[i] + op_encoded_size(codes[i]);
 	}
 }
 
+int line2addr(int line) {
+	return addresses[line];
+}
+
+/*
+	the line of each label is looked up once, the addresses are worked 
+	out again before each pass as the widths of the ops settle
+*/
+
 void emit_label_to_address() {
+	int *targets = malloc(sizeof(int) * code_counter);
+	for(int i = 0; i < code_counter; i++) {
+		targets[i] = codes[i]->label ? emit_get_label(codes[i]->label).line : -1;
+	}
+
 	int passes = 0;
 	int done = false;
 	while(done != true) {
 		done = true;
+		emit_addresses();
+
 		for(int i = 0; i < code_counter; i++) {
 			Op *current = codes[i];
 
 			uint8_t op = current->op;
 
 			if(op_size[op]) {
-				if(current->label) {
-					Label label = emit_get_label(current->label);
-					current->left = line2addr(label.line);
+				if(targets[i] >= 0) {
+					current->left = line2addr(targets[i]);
 				}
 
 				if(current->width != closest_container_size(current->left)) {
@@ -64,6 +89,8 @@ void emit_label_to_address() {
 		passes++;
 	}
 
+	free(targets);
+
 	printf("passes %i\n", passes);
 }
 
@@ -90,11 +117,20 @@ static Op *emit_op(OpType op) {
 	return emit_op_left(op, 0);
 }
 
-static Op *emit_op_left(OpType op, uint64_t left) {
+Op *new_op(OpType op, uint64_t left, int64_t right, int64_t dest) {
 	Op *ins = malloc(sizeof(Op));
 	ins->op = op;
 	ins->left = left;
+	ins->right = right;
+	ins->dest = dest;
 	ins->label = NULL;
+	ins->width = 0;
+
+	return ins;
+}
+
+static Op *emit_op_left(OpType op, uint64_t left) {
+	Op *ins = new_op(op, left, 0, 0);
 
 	codes[code_counter++] = ins;
 
@@ -102,8 +138,7 @@ static Op *emit_op_left(OpType op, uint64_t left) {
 }
 
 static Op *emit_op_left_label(OpType op, const char *left) {
-	Op *ins = malloc(sizeof(Op));
-	ins->op = op;
+	Op *ins = new_op(op, 0, 0, 0);
 	ins->label = strdup(left);
 
 	codes[code_counter++] = ins;
@@ -111,11 +146,24 @@ static Op *emit_op_left_label(OpType op, const char *left) {
 	return ins;
 }
 
-static int emit_constant(List *list, char *data, bool obfuscated) {
+/* a call carries the argument count and the frame size of the method */
+static Op *emit_call(TyMethod *method, int arg_count) {
+	char label[256];
+	sprintf(label, "SUB_%p_%s", method, method->name);
+
+	Op *ins = emit_op_left_label(OP_CALL, label);
+	ins->right = arg_count;
+	ins->dest  = method->locals;
+
+	return ins;
+}
+
+/* the length is kept from the token, the bytes may hold a 0 */
+static int emit_constant(List *list, char *data, int length, bool obfuscated) {
 	int i = 0;
 	for(ListNode *c = list_begin(list); c != list_end(list); c = list_next(c)) {
 		Constant *constant = (Constant*)c;
-		if(strcmp(data, constant->data) == 0 && constant->obfuscated == obfuscated) {
+		if(constant->length == length && memcmp(data, constant->data, length) == 0 && constant->obfuscated == obfuscated) {
 			return i;
 		}
 		i++;
@@ -123,11 +171,40 @@ static int emit_constant(List *list, char *data, bool obfuscated) {
 
 	Constant *constant = malloc(sizeof(Constant));
 	constant->data = data;
+	constant->length = length;
 	constant->obfuscated = obfuscated;
 	list_insert(list_end(list), constant);
 	return list_size(list) - 1;
 }
 
+static void emit_oprand(FILE *prg, int64_t value, uint8_t width) {
+	if(width == 0) {
+		int8_t value8 = value & 0xFF;
+		fwrite(&value8, sizeof(value8), 1, prg);
+	}
+	if(width == 1) {
+		int16_t value16 = HTONS(value & 0xFFFF);
+		fwrite(&value16, sizeof(value16), 1, prg);
+	}
+	if(width == 2) {
+		int32_t value32 = HTONL(value & 0xFFFFFFFF);
+		fwrite(&value32, sizeof(value32), 1, prg);
+	}
+	if(width == 3) {
+		int64_t value64 = HTONLL(value & 0xFFFFFFFFFFFFFFFF);
+		fwrite(&value64, sizeof(value64), 1, prg);
+	}
+}
+
+/* zeros up to the next align bytes of the file */
+static void emit_pad(FILE *prg, int align) {
+	long position = ftell(prg);
+
+	while(position++ % align) {
+		fputc(0, prg);
+	}
+}
+
 static void emit_file(const char *file) {
 	FILE *prg = fopen(file, "wb");
 	if(!prg) {
@@ -137,12 +214,18 @@ static void emit_file(const char *file) {
 
 	uint64_t code_size = line2addr(code_counter - 1) + 1;
 	uint64_t const_size = list_size(&constants);
+	uint64_t pool_size = CONST_ROUND(const_size * sizeof(uint64_t));
+
+	for(ListNode *c = list_begin(&constants); c != list_end(&constants); c = list_next(c)) {
+		pool_size += CONST_HEADER + CONST_ROUND(((Constant*)c)->length + 1);
+	}
 
 	chip_hdr_t hdr = {
-		.magic      = { 0x7F, 0x43, 0x48, 0x49, 0x50 },
+		.magic      = CHIP_MAGIC,
 		.version    = HTONL(CHIP_VERSION),
 		.code_size  = HTONLL(code_size),
 		.const_size = HTONLL(const_size),
+		.pool_size  = HTONLL(pool_size),
 		.entry      = HTONLL(0l)
 	};
 
@@ -151,62 +234,92 @@ static void emit_file(const char *file) {
 	for(int i = 0; i < code_counter; ++i) {
 		Op *current = codes[i];
 
-		uint8_t op    = current->op;
-		int64_t left  = current->left;
-		uint8_t width = current->width;
+		uint8_t op       = current->op;
+		int     oprands  = op_size[op];
+		uint8_t widths[] = {
+			current->width,
+			closest_container_size(current->right),
+			closest_container_size(current->dest)
+		};
+		int64_t values[] = {
+			current->left,
+			current->right,
+			current->dest
+		};
+
+		fwrite(&op, sizeof(op), 1, prg);
+
+		if(oprands > 0) {
+			uint8_t encoded_widths = 0;
+			for(int o = 0; o < oprands; o++) {
+				encoded_widths |= widths[o] << (o * 2);
+			}
+			fwrite(&encoded_widths, sizeof(encoded_widths), 1, prg);
+		}
 
-		uint8_t encoded_op   = (op << 2) | (width & 0x03);
-		int64_t encoded_left = (left & 0xFFFFFFFFFFFFFFFF);
+		for(int o = 0; o < oprands; o++) {
+			emit_oprand(prg, values[o], widths[o]);
+		}
+	}
 
-		fwrite(&encoded_op, sizeof(encoded_op), 1, prg);
+	emit_pad(prg, CONST_PAGE);
 
-		if(op_size[op]) {
-			if(width == 0) {
-				int8_t left8 = encoded_left & 0xFF;
-				fwrite(&left8, sizeof(left8), 1, prg);
-			}
-			if(width == 1) {
-				int16_t left16 = HTONS(encoded_left & 0xFFFF);
-				fwrite(&left16, sizeof(left16), 1, prg);
-			}
-			if(width == 2) {
-				int32_t left32 = HTONL(encoded_left & 0xFFFFFFFF);
-				fwrite(&left32, sizeof(left32), 1, prg);
-			}
-			if(width == 3) {
-				int64_t left64 = HTONLL(encoded_left & 0xFFFFFFFFFFFFFFFF);
-				fwrite(&left64, sizeof(left64), 1, prg);
-			}
-		}
+	uint64_t offset = CONST_ROUND(const_size * sizeof(uint64_t));
+	for(ListNode *c = list_begin(&constants); c != list_end(&constants); c = list_next(c)) {
+		uint64_t offset64 = HTONLL(offset);
+		fwrite(&offset64, sizeof(offset64), 1, prg);
+
+		offset += CONST_HEADER + CONST_ROUND(((Constant*)c)->length + 1);
 	}
 
+	emit_pad(prg, CONST_ALIGN);
+
 	for(ListNode *c = list_begin(&constants); c != list_end(&constants); c = list_next(c)) {
 		Constant *constant = (Constant*)c;
-	
-		int constant_size = strlen(constant->data);
 
-		fwrite(&constant_size, sizeof(constant_size), 1, prg);
-		fwrite(constant->data, sizeof(char), constant_size, prg);
+		uint64_t length   = constant->length;
+		uint64_t length64 = HTONLL(length);
+		char     header[CONST_HEADER] = {};
+
+		memcpy(header + CONST_HEADER / 2, &length64, sizeof(length64));
+
+		fwrite(header, sizeof(char), CONST_HEADER, prg);
+		fwrite(constant->data, sizeof(char), length + 1, prg);
+
+		emit_pad(prg, CONST_ALIGN);
 	}
 
 	fclose(prg);
 }
 
 void emit_asm() {
+	/* the first label of each line */
+	Label **at = calloc(code_counter + 1, sizeof(Label*));
+	for(int i = label_counter - 1; i >= 0; i--) {
+		if(labels[i].line >= 0 && labels[i].line <= code_counter) {
+			at[labels[i].line] = &labels[i];
+		}
+	}
+
 	for(int pc = 0; pc < code_counter; pc++) {
 		Op *ins = codes[pc];
 
 		printf(COLOR_WHITE "0x%02x" COLOR_RESET, line2addr(pc));
 
-		for(int i = 0; i < label_counter; ++i) {
-			if((labels[i].line) == pc) {
-				printf("\t" COLOR_BLUE "%s:" COLOR_RESET "\n", labels[i].name);
-				break;
-			}
-		} 
+		if(at[pc]) {
+			printf("\t" COLOR_BLUE "%s:" COLOR_RESET "\n", at[pc]->name);
+		}
 
 		printf("\t\t" COLOR_YELLOW "%s" COLOR_RESET " ", op_display[ins->op]);
 
+		if(op_size[ins->op] > 2) {
+			printf(COLOR_GREEN "r%li" COLOR_RESET ", ", ins->dest);
+		}
+
+		if(op_size[ins->op] > 1) {
+			printf(COLOR_GREEN "r%li" COLOR_RESET ", ", ins->right);
+		}
+
 		if(op_size[ins->op]) {
 			printf(COLOR_CYAN "i%i" COLOR_RESET " ", 8 * (1 << ins->width));
 
@@ -220,6 +333,8 @@ void emit_asm() {
 
 		printf("\n");
 	}
+
+	free(at);
 }
 
 uint8_t closest_container_size(int64_t number) {
@@ -252,17 +367,6 @@ static void gen_class(Node *node) {
 	}
 }
 
-static int gen_param(Node *node) {
-	int i = 0;
-	while(!list_empty(&node->bodylist)) {
-		Node *entry = (Node*)list_remove(list_back(&node->bodylist));
-		gen_store(entry);
-		i++;
-	}
-
-	return i;
-}
-
 static int gen_arg(Node *node) {
 	int i = 0;
 	while(!list_empty(&node->bodylist)) {
@@ -280,10 +384,10 @@ static void gen_method(Node *node) {
 
 	emit_label(label);
 
-	gen_visitor(node->args);
+	/* before the body is consumed */
+	bounds(node);
 
-	/* this */
-	emit_op_left(OP_STORE, 0);
+	/* call already put this and the parameters in slots 0 to n */
 
 	while(!list_empty(&node->bodylist)) {
 		Node *entry = (Node*)list_remove(list_begin(&node->bodylist));
@@ -401,13 +505,7 @@ static void gen_new(Node *node) {
 	if(node->method) {
 		emit_op(OP_DUP);
 	
-		int arg_count = gen_arg(node->args);
-
-		char label[256];
-		sprintf(label, "SUB_%p_%s", node->method, node->method->name);
-
-		emit_op_left(OP_PUSH, arg_count);
-		emit_op_left_label(OP_CALL, label);
+		emit_call(node->method, gen_arg(node->args));
 
 		// discard constructor return
 		emit_op(OP_POP);
@@ -415,12 +513,17 @@ static void gen_new(Node *node) {
 }
 
 static void gen_new_array(Node *node) {
+	/* newarr takes the element count, it scales by the element size itself */
 	gen_visitor(node->args);
 
-	emit_op_left(OP_PUSH, node->ty->size);
-	emit_op(OP_MUL);
-
-	emit_op_left(OP_NEW_ARRAY, node->ty->size);
+	/* arrays of objects or of arrays are scanned by the collector */
+	if(!type_is_primitive(node->ty) || node->data_type->array_depth > 1) {
+		emit_op_left(OP_NEW_REF_ARRAY, node->ty->size);
+	} else if(node->in_frame) {
+		emit_op_left(OP_NEW_LOCAL_ARRAY, node->ty->size);
+	} else {
+		emit_op_left(OP_NEW_ARRAY, node->ty->size);
+	}
 }
 
 static void gen_array_member(Node *node) {
@@ -428,10 +531,12 @@ static void gen_array_member(Node *node) {
 		gen_visitor(node->body);
 		gen_visitor(node->index);
 
-		emit_op_left(OP_PUSH, node->ty->size); // scale
-		emit_op(OP_MUL);
-
-		emit_op(OP_LOAD_ARRAY);
+		/* the op scales the index by its element width */
+		if(node->in_bounds) {
+			emit_op(node->ty->size == 1 ? OP_LOAD_ARRAY_I8_U : OP_LOAD_ARRAY_I64_U);
+		} else {
+			emit_op(node->ty->size == 1 ? OP_LOAD_ARRAY_I8 : OP_LOAD_ARRAY_I64);
+		}
 	}
 }
 
@@ -462,10 +567,11 @@ static void gen_store(Node *node) {
 			/* x[y] = z */
 			gen_visitor(node->index);
 
-			emit_op_left(OP_PUSH, node->ty->size); // scale
-			emit_op(OP_MUL);
-
-			emit_op(OP_STORE_ARRAY);
+			if(node->in_bounds) {
+				emit_op(node->ty->size == 1 ? OP_STORE_ARRAY_I8_U : OP_STORE_ARRAY_I64_U);
+			} else {
+				emit_op(node->ty->size == 1 ? OP_STORE_ARRAY_I8 : OP_STORE_ARRAY_I64);
+			}
 		} else {
 			/* x.y = z */
 			emit_op_left(OP_STORE_FIELD, node->offset);
@@ -663,7 +769,8 @@ static void gen_float(Node *node) {
 }
 
 static void gen_string(Node *node) {
-	emit_op_left(OP_LOAD_CONST, emit_constant(&constants, node->token->data, false));
+	/* a constant that is never written needs no copy of its own */
+	emit_op_left(node->shared ? OP_LOAD_CONST_SHARED : OP_LOAD_CONST, emit_constant(&constants, node->token->data, node->token->length, false));
 
 	// emit_op_left(OP_PUSH, strlen(node->token->data));
 	// emit_op_left(OP_NEW_ARRAY, 0);
@@ -692,13 +799,7 @@ static void gen_return(Node *node) {
 static void gen_call(Node *node) {
 	gen_visitor(node->body);
 
-	int arg_count = gen_arg(node->args);
-
-	char label[256];
-	sprintf(label, "SUB_%p_%s", node->method, node->method->name);
-
-	emit_op_left(OP_PUSH, arg_count);
-	emit_op_left_label(OP_CALL, label);
+	emit_call(node->method, gen_arg(node->args));
 }
 
 static void gen_syscall(Node *node) {
@@ -720,10 +821,6 @@ static void gen_visitor(Node *node) {
 			gen_class(node);
 		}
 		break;
-		case ND_PARAM: {
-			gen_param(node);
-		}
-		break;
 		case ND_ARG: {
 			gen_arg(node);
 		}
@@ -869,18 +966,18 @@ void gen(Node *node, const char *file) {
 		exit(1);
 	}
 
-	char entry_label[256];
-	sprintf(entry_label, "SUB_%p_%s", m, m->name);
-
 	emit_label("entry_point");
-	emit_op_left(OP_PUSH, 0);
-	emit_op_left_label(OP_CALL, entry_label);
+	emit_op_left(OP_PUSH, 0); // this
+	emit_call(m, 0);
 	emit_op_left(OP_PUSH, 0);
 	emit_op(OP_HALT);
 
+	/* before any method is consumed */
+	escape(node);
+
 	gen_visitor(node);
 
-	optimize(codes, code_counter, labels, label_counter);
+	code_counter = optimize(codes, code_counter, labels, label_counter);
 
 	emit_label_to_address();
 	emit_asm();
@@ -2,87 +2,157 @@
 #define GEN_H
 
 #include "parse.h"
+#include <stdio.h>
 #include <stdint.h>
 #include <arpa/inet.h>
 
 #define LIST_OF_OPS \
-	DEFINE_OP(OP_NOP, "nop", false) \
-	DEFINE_OP(OP_LOAD, "load", true) \
-	DEFINE_OP(OP_LOAD_0, "load_0", false) \
-	DEFINE_OP(OP_LOAD_1, "load_1", false) \
-	DEFINE_OP(OP_LOAD_2, "load_2", false) \
-	DEFINE_OP(OP_LOAD_3, "load_3", false) \
-	DEFINE_OP(OP_LOAD_4, "load_4", false) \
-	DEFINE_OP(OP_LOAD_5, "load_5", false) \
-	DEFINE_OP(OP_STORE, "store", true) \
-	DEFINE_OP(OP_STORE_0, "store_0", false) \
-	DEFINE_OP(OP_STORE_1, "store_1", false) \
-	DEFINE_OP(OP_STORE_2, "store_2", false) \
-	DEFINE_OP(OP_STORE_3, "store_3", false) \
-	DEFINE_OP(OP_STORE_4, "store_4", false) \
-	DEFINE_OP(OP_STORE_5, "store_5", false) \
-	DEFINE_OP(OP_PUSH,  "push", true) \
-	DEFINE_OP(OP_PUSH_0,  "push_0", false) \
-	DEFINE_OP(OP_PUSH_1,  "push_1", false) \
-	DEFINE_OP(OP_PUSH_2,  "push_2", false) \
-	DEFINE_OP(OP_PUSH_3,  "push_3", false) \
-	DEFINE_OP(OP_PUSH_4,  "push_4", false) \
-	DEFINE_OP(OP_PUSH_5,  "push_5", false) \
-	DEFINE_OP(OP_POP, "pop", false) \
-	DEFINE_OP(OP_CMPEQ, "cmpeq", false) \
-	DEFINE_OP(OP_CMPGT, "cmpgt", false) \
-	DEFINE_OP(OP_CMPLT, "cmplt", false) \
-	DEFINE_OP(OP_SHR, "shr", false) \
-	DEFINE_OP(OP_SHL, "shl", false) \
-	DEFINE_OP(OP_ADD, "add", false) \
-	DEFINE_OP(OP_SUB, "sub", false) \
-	DEFINE_OP(OP_MUL, "mul", false) \
-	DEFINE_OP(OP_DIV, "div", false) \
-	DEFINE_OP(OP_NEG, "neg", false) \
-	DEFINE_OP(OP_MOD, "mod", false) \
-	DEFINE_OP(OP_NOT, "not", false) \
-	DEFINE_OP(OP_OR, "or", false) \
-	DEFINE_OP(OP_XOR, "xor", false) \
-	DEFINE_OP(OP_AND, "and", false) \
-	DEFINE_OP(OP_FADD, "fadd", false) \
-	DEFINE_OP(OP_FSUB, "fsub", false) \
-	DEFINE_OP(OP_FMUL, "fmul", false) \
-	DEFINE_OP(OP_FDIV, "fdiv", false) \
-	DEFINE_OP(OP_FNEG, "fneg", false) \
-	DEFINE_OP(OP_FMOD, "fmod", false) \
-	DEFINE_OP(OP_I2F, "i2f", false) \
-	DEFINE_OP(OP_DUP, "dup", false) \
-	DEFINE_OP(OP_LOAD_CONST, "loadconst", true) \
-	DEFINE_OP(OP_LOAD_FIELD, "loadfield", true) \
-	DEFINE_OP(OP_STORE_FIELD, "storefield", true) \
-	DEFINE_OP(OP_CALL, "call", true) \
-	DEFINE_OP(OP_SYSCALL, "syscall", false) \
-	DEFINE_OP(OP_ALLOC, "alloc", true) \
-	DEFINE_OP(OP_NEW_ARRAY, "newarr", true) \
-	DEFINE_OP(OP_LOAD_ARRAY, "loadarr", false) \
-	DEFINE_OP(OP_STORE_ARRAY, "storearr", false) \
-	DEFINE_OP(OP_JE, "je", true) \
-	DEFINE_OP(OP_JMP, "jmp", true) \
-	DEFINE_OP(OP_RET, "ret", false) \
-	DEFINE_OP(OP_HALT, "halt", false)
+	DEFINE_OP(OP_NOP, "nop", 0, 0, 0) \
+	DEFINE_OP(OP_LOAD, "load", 1, 0, 1) \
+	DEFINE_OP(OP_LOAD_0, "load_0", 0, 0, 1) \
+	DEFINE_OP(OP_LOAD_1, "load_1", 0, 0, 1) \
+	DEFINE_OP(OP_LOAD_2, "load_2", 0, 0, 1) \
+	DEFINE_OP(OP_LOAD_3, "load_3", 0, 0, 1) \
+	DEFINE_OP(OP_LOAD_4, "load_4", 0, 0, 1) \
+	DEFINE_OP(OP_LOAD_5, "load_5", 0, 0, 1) \
+	DEFINE_OP(OP_STORE, "store", 1, 1, 0) \
+	DEFINE_OP(OP_STORE_0, "store_0", 0, 1, 0) \
+	DEFINE_OP(OP_STORE_1, "store_1", 0, 1, 0) \
+	DEFINE_OP(OP_STORE_2, "store_2", 0, 1, 0) \
+	DEFINE_OP(OP_STORE_3, "store_3", 0, 1, 0) \
+	DEFINE_OP(OP_STORE_4, "store_4", 0, 1, 0) \
+	DEFINE_OP(OP_STORE_5, "store_5", 0, 1, 0) \
+	DEFINE_OP(OP_PUSH, "push", 1, 0, 1) \
+	DEFINE_OP(OP_PUSH_0, "push_0", 0, 0, 1) \
+	DEFINE_OP(OP_PUSH_1, "push_1", 0, 0, 1) \
+	DEFINE_OP(OP_PUSH_2, "push_2", 0, 0, 1) \
+	DEFINE_OP(OP_PUSH_3, "push_3", 0, 0, 1) \
+	DEFINE_OP(OP_PUSH_4, "push_4", 0, 0, 1) \
+	DEFINE_OP(OP_PUSH_5, "push_5", 0, 0, 1) \
+	DEFINE_OP(OP_POP, "pop", 0, 1, 0) \
+	DEFINE_OP(OP_CMPEQ, "cmpeq", 0, 2, 1) \
+	DEFINE_OP(OP_CMPGT, "cmpgt", 0, 2, 1) \
+	DEFINE_OP(OP_CMPLT, "cmplt", 0, 2, 1) \
+	DEFINE_OP(OP_SHR, "shr", 0, 2, 1) \
+	DEFINE_OP(OP_SHL, "shl", 0, 2, 1) \
+	DEFINE_OP(OP_ADD, "add", 0, 2, 1) \
+	DEFINE_OP(OP_SUB, "sub", 0, 2, 1) \
+	DEFINE_OP(OP_MUL, "mul", 0, 2, 1) \
+	DEFINE_OP(OP_DIV, "div", 0, 2, 1) \
+	DEFINE_OP(OP_NEG, "neg", 0, 1, 1) \
+	DEFINE_OP(OP_MOD, "mod", 0, 2, 1) \
+	DEFINE_OP(OP_NOT, "not", 0, 1, 1) \
+	DEFINE_OP(OP_OR, "or", 0, 2, 1) \
+	DEFINE_OP(OP_XOR, "xor", 0, 2, 1) \
+	DEFINE_OP(OP_AND, "and", 0, 2, 1) \
+	DEFINE_OP(OP_FADD, "fadd", 0, 2, 1) \
+	DEFINE_OP(OP_FSUB, "fsub", 0, 2, 1) \
+	DEFINE_OP(OP_FMUL, "fmul", 0, 2, 1) \
+	DEFINE_OP(OP_FDIV, "fdiv", 0, 2, 1) \
+	DEFINE_OP(OP_FNEG, "fneg", 0, 1, 1) \
+	DEFINE_OP(OP_FMOD, "fmod", 0, 2, 1) \
+	DEFINE_OP(OP_I2F, "i2f", 0, 1, 1) \
+	DEFINE_OP(OP_DUP, "dup", 0, 1, 2) \
+	DEFINE_OP(OP_LOAD_CONST, "loadconst", 1, 0, 1) \
+	DEFINE_OP(OP_LOAD_CONST_SHARED, "loadconst.shared", 1, 0, 1) \
+	DEFINE_OP(OP_LOAD_FIELD, "loadfield", 1, 1, 1) \
+	DEFINE_OP(OP_STORE_FIELD, "storefield", 1, 2, 0) \
+	DEFINE_OP(OP_CALL, "call", 3, -1, -1) \
+	DEFINE_OP(OP_SYSCALL, "syscall", 0, -1, -1) \
+	DEFINE_OP(OP_ALLOC, "alloc", 1, 0, 1) \
+	DEFINE_OP(OP_NEW_ARRAY, "newarr", 1, 1, 1) \
+	DEFINE_OP(OP_NEW_LOCAL_ARRAY, "newarr.local", 1, 1, 1) \
+	DEFINE_OP(OP_NEW_REF_ARRAY, "newrefarr", 1, 1, 1) \
+	DEFINE_OP(OP_LOAD_ARRAY_I8, "loadarr_i8", 0, 2, 1) \
+	DEFINE_OP(OP_LOAD_ARRAY_I64, "loadarr_i64", 0, 2, 1) \
+	DEFINE_OP(OP_STORE_ARRAY_I8, "storearr_i8", 0, 3, 0) \
+	DEFINE_OP(OP_STORE_ARRAY_I64, "storearr_i64", 0, 3, 0) \
+	DEFINE_OP(OP_LOAD_ARRAY_I8_U, "loadarr_i8.u", 0, 2, 1) \
+	DEFINE_OP(OP_LOAD_ARRAY_I64_U, "loadarr_i64.u", 0, 2, 1) \
+	DEFINE_OP(OP_STORE_ARRAY_I8_U, "storearr_i8.u", 0, 3, 0) \
+	DEFINE_OP(OP_STORE_ARRAY_I64_U, "storearr_i64.u", 0, 3, 0) \
+	DEFINE_OP(OP_JE, "je", 1, 2, 0) \
+	DEFINE_OP(OP_JMP, "jmp", 1, 0, 0) \
+	DEFINE_OP(OP_RET, "ret", 0, 1, 0) \
+	DEFINE_OP(OP_HALT, "halt", 0, 1, 0) \
+	LIST_OF_REGISTER_OPS \
+	LIST_OF_SUPER_OPS
+
+/*
+	register ops work on frame slots directly, dest = right <op> left. 
+	the .ri forms take left as an immediate instead of a slot
+*/
+
+#define LIST_OF_REGISTER_OPS \
+	DEFINE_OP(OP_MOV, "mov", 3, 0, 0) \
+	DEFINE_OP(OP_MOVI, "movi", 3, 0, 0) \
+	DEFINE_REGISTER_OP(ADD, "add") \
+	DEFINE_REGISTER_OP(SUB, "sub") \
+	DEFINE_REGISTER_OP(MUL, "mul") \
+	DEFINE_REGISTER_OP(DIV, "div") \
+	DEFINE_REGISTER_OP(MOD, "mod") \
+	DEFINE_REGISTER_OP(AND, "and") \
+	DEFINE_REGISTER_OP(OR, "or") \
+	DEFINE_REGISTER_OP(XOR, "xor") \
+	DEFINE_REGISTER_OP(SHL, "shl") \
+	DEFINE_REGISTER_OP(SHR, "shr") \
+	DEFINE_REGISTER_OP(CMPEQ, "cmpeq") \
+	DEFINE_REGISTER_OP(CMPGT, "cmpgt") \
+	DEFINE_REGISTER_OP(CMPLT, "cmplt")
+
+#define DEFINE_REGISTER_OP(name, display) \
+	DEFINE_OP(OP_##name##_RR, display ".rr", 3, 0, 0) \
+	DEFINE_OP(OP_##name##_RI, display ".ri", 3, 0, 0)
+
+/*
+	superinstructions fuse the hottest sequences of a profile (see 
+	make profile), right is a frame slot and left the immediate or 
+	jump target. the _jz forms jump when the comparison is false
+
+	load x, push k, add, store x => inc_local x, k
+	load x, push 0, je l         => jz_local x, l
+	<cmp>, push 0, je l          => <cmp>_jz l
+	push 0, je l                 => jz l
+*/
+
+#define LIST_OF_SUPER_OPS \
+	DEFINE_OP(OP_INC_LOCAL, "inc_local", 2, 0, 0) \
+	DEFINE_OP(OP_JZ, "jz", 1, 1, 0) \
+	DEFINE_OP(OP_JZ_LOCAL, "jz_local", 2, 0, 0) \
+	DEFINE_OP(OP_CMPEQ_JZ, "cmpeq_jz", 1, 2, 0) \
+	DEFINE_OP(OP_CMPGT_JZ, "cmpgt_jz", 1, 2, 0) \
+	DEFINE_OP(OP_CMPLT_JZ, "cmplt_jz", 1, 2, 0)
 
 /* ops */
-#define DEFINE_OP(name, display, left) name,
+#define DEFINE_OP(name, display, oprands, pops, pushes) name,
 typedef enum {
 	LIST_OF_OPS
 } OpType;
 #undef DEFINE_OP
 
 /* mnemonic names for ops */
-#define DEFINE_OP(name, display, left) display,
+#define DEFINE_OP(name, display, oprands, pops, pushes) display,
 static char *op_display[] = {
 	LIST_OF_OPS
 };
 #undef DEFINE_OP
 
-/* ops that has a left oprand */
-#define DEFINE_OP(name, display, left) left,
-static bool op_size[] = {
+/* number of oprands, encoded in the order left, right, dest */
+#define DEFINE_OP(name, display, oprands, pops, pushes) oprands,
+static int op_size[] = {
+	LIST_OF_OPS
+};
+#undef DEFINE_OP
+
+/* slots taken from and put on the stack, -1 when it depends on the oprand */
+#define DEFINE_OP(name, display, oprands, pops, pushes) pops,
+static int op_pops[] = {
+	LIST_OF_OPS
+};
+#undef DEFINE_OP
+
+#define DEFINE_OP(name, display, oprands, pops, pushes) pushes,
+static int op_pushes[] = {
 	LIST_OF_OPS
 };
 #undef DEFINE_OP
@@ -90,6 +160,7 @@ static bool op_size[] = {
 typedef struct _Constant {
 	ListNode node;
 	char *data;
+	int length;
 	bool obfuscated;
 } Constant;
 
@@ -102,6 +173,8 @@ typedef struct {
 typedef struct _Op {
 	OpType op;
 	uint64_t left;
+	int64_t right;
+	int64_t dest;
 	char *label;
 	int width;
 } Op;
@@ -111,6 +184,7 @@ typedef struct __attribute__((__packed__)) {
 	uint32_t version;
 	uint64_t code_size;
 	uint64_t const_size;
+	uint64_t pool_size;
 	uint64_t entry;
 } chip_hdr_t;
 
@@ -122,15 +196,19 @@ Label             emit_label(const char *name);
 static Op        *emit_op(OpType op);
 static Op        *emit_op_left(OpType op, uint64_t left);
 static Op        *emit_op_left_label(OpType op, const char *left);
-static int        emit_constant(List *list, char *data, bool obfuscated);
+static Op        *emit_call(TyMethod *method, int arg_count);
+Op               *new_op(OpType op, uint64_t left, int64_t right, int64_t dest);
+static int        emit_constant(List *list, char *data, int length, bool obfuscated);
+static void       emit_oprand(FILE *prg, int64_t value, uint8_t width);
+static void       emit_pad(FILE *prg, int align);
 static void       emit_file(const char *file);
 
 uint8_t           closest_container_size(int64_t number);
+int               op_encoded_size(Op *ins);
 
 static void       gen_program(Node *node);
 static void       gen_import(Node *node);
 static void       gen_class(Node *node);
-static int        gen_param(Node *node);
 static int        gen_arg(Node *node);
 static void       gen_method(Node *node);
 static void       gen_if(Node *node);
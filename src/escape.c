@@ -0,0 +1,329 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "escape.h"
+
+/*
+	Chip escape analysis
+
+	a local escapes once its value goes anywhere but a read of one of
+	its fields or elements, a store into one, or an argument the
+	callee does not let escape either. syscalls never keep what they
+	are passed, except 5 which frees it, and fill every array they are
+	passed except the source of a copy (8000). a local is written once
+	one of its fields or elements is stored into, here or in a callee.
+
+	a primitive array that is only ever kept in a local that does not
+	escape, or passed straight to such an argument, can not outlive
+	the method that allocates it. outside of loops those allocations
+	are marked in_frame and codegen gives them newarr.local, which
+	takes them from a region freed when the method returns instead of
+	from the heap. a string constant that goes the same way and is
+	never written either is marked shared and codegen gives it
+	loadconst.shared, which pushes the constant itself instead of a
+	copy of it
+
+	which parameters escape or are written is found for all methods
+	at once, nothing is at first and the methods are walked until
+	nothing more is
+*/
+
+typedef struct {
+	Node *node;
+	int   locals;
+	bool *escapes;    /* by frame slot */
+	bool *writes;     /* by frame slot */
+} EscapeMethod;
+
+/* what a callee or a syscall does with an argument */
+typedef struct {
+	bool escapes;
+	bool written;
+} EscapeUse;
+
+static EscapeMethod *methods      = NULL;
+static int           method_count = 0;
+static int           method_size  = 0;
+
+/* a slot escaped or was written in the last walk */
+static bool changed = false;
+
+static void escape_walk(Node *node, EscapeMethod *method);
+
+static void escape_collect(Node *node) {
+	if(!node) {
+		return;
+	}
+
+	switch(node->type) {
+		case ND_IMPORT: {
+			escape_collect(node->body);
+		}
+		break;
+		case ND_PROGRAM:
+		case ND_CLASS: {
+			for(ListNode *it = list_begin(&node->bodylist); it != list_end(&node->bodylist); it = list_next(it)) {
+				escape_collect((Node*)it);
+			}
+		}
+		break;
+		case ND_METHOD: {
+			if(method_count == method_size) {
+				method_size = method_size ? method_size * 2 : 64;
+				methods = realloc(methods, sizeof(EscapeMethod) * method_size);
+				if(!methods) {
+					printf("out of memory\n");
+					exit(1);
+				}
+			}
+
+			methods[method_count++] = (EscapeMethod){
+				.node    = node,
+				.locals  = node->method->locals,
+				.escapes = calloc(node->method->locals + 1, sizeof(bool)),
+				.writes  = calloc(node->method->locals + 1, sizeof(bool))
+			};
+		}
+		break;
+	}
+}
+
+static EscapeMethod *escape_find(TyMethod *method) {
+	for(int m = 0; m < method_count; m++) {
+		if(methods[m].node->method == method) {
+			return &methods[m];
+		}
+	}
+	return NULL;
+}
+
+/* a local, not the name of a class a static call goes through */
+static bool escape_local(Node *node) {
+	return node && node->type == ND_VARIABLE && !type_get(node->token->data);
+}
+
+static bool escape_primitive_array(Node *node) {
+	return node && node->type == ND_NEWARRAY && type_is_primitive(node->ty) && node->data_type->array_depth <= 1;
+}
+
+/* index counts the arguments of a call, this not included, and of a syscall, its name included */
+static EscapeUse escape_use(Node *call, int index) {
+	if(call->type == ND_SYSCALL) {
+		Node *name = (Node*)list_begin(&call->args->bodylist);
+		if(name->type != ND_NUMBER) {
+			return (EscapeUse){ .escapes = true, .written = true };
+		}
+
+		long number = atol(name->token->data);
+		return (EscapeUse){ .escapes = number == 5, .written = !(number == 8000 && index == 3) };
+	}
+
+	EscapeMethod *method = call->method ? escape_find(call->method) : NULL;
+	if(!method || index + 1 >= method->locals) {
+		return (EscapeUse){ .escapes = true, .written = true };
+	}
+
+	return (EscapeUse){ .escapes = method->escapes[index + 1], .written = method->writes[index + 1] };
+}
+
+static void escape_mark(EscapeMethod *method, bool *slots, int slot) {
+	if(slot >= method->locals) {
+		return;
+	}
+	if(!slots[slot]) {
+		slots[slot] = true;
+		changed = true;
+	}
+}
+
+/* reading or storing a field or an element keeps the object itself in place */
+static void escape_access(Node *node, EscapeMethod *method) {
+	if(!escape_local(node->body)) {
+		escape_walk(node->body, method);
+	}
+	escape_walk(node->index, method);
+}
+
+static void escape_args(Node *call, EscapeMethod *method) {
+	if(!call->args) {
+		return;
+	}
+
+	int index = 0;
+	for(ListNode *it = list_begin(&call->args->bodylist); it != list_end(&call->args->bodylist); it = list_next(it), index++) {
+		Node *arg = (Node*)it;
+		if(!escape_local(arg)) {
+			escape_walk(arg, method);
+			continue;
+		}
+
+		EscapeUse use = escape_use(call, index);
+		if(use.escapes) {
+			escape_mark(method, method->escapes, arg->offset);
+		}
+		if(use.written) {
+			escape_mark(method, method->writes, arg->offset);
+		}
+	}
+}
+
+static void escape_walk(Node *node, EscapeMethod *method) {
+	if(!node) {
+		return;
+	}
+
+	switch(node->type) {
+		case ND_VARIABLE: {
+			if(escape_local(node)) {
+				escape_mark(method, method->escapes, node->offset);
+			}
+		}
+		break;
+		case ND_MEMBER:
+		case ND_ARRAYMEMBER: {
+			escape_access(node, method);
+		}
+		break;
+		case ND_ASSIGN: {
+			Node *left = node->left;
+			if(left->type != ND_VARIABLE) {
+				if(escape_local(left->body)) {
+					escape_mark(method, method->writes, left->body->offset);
+				}
+				escape_access(left, method);
+			}
+			escape_walk(node->right, method);
+		}
+		break;
+		case ND_CALL: {
+			escape_walk(node->body, method);
+			escape_args(node, method);
+		}
+		break;
+		case ND_NEW:
+		case ND_SYSCALL: {
+			escape_args(node, method);
+		}
+		break;
+		default: {
+			escape_walk(node->left, method);
+			escape_walk(node->right, method);
+			escape_walk(node->body, method);
+			escape_walk(node->args, method);
+			escape_walk(node->init, method);
+			escape_walk(node->condition, method);
+			escape_walk(node->increment, method);
+			escape_walk(node->index, method);
+			escape_walk(node->alternate, method);
+
+			for(ListNode *it = list_begin(&node->bodylist); it != list_end(&node->bodylist); it = list_next(it)) {
+				escape_walk((Node*)it, method);
+			}
+		}
+		break;
+	}
+}
+
+/* value ends up somewhere it does not escape from */
+static void escape_place(Node *value, bool written, bool loop) {
+	if(escape_primitive_array(value) && !loop) {
+		value->in_frame = true;
+	}
+	if(value->type == ND_STRING && !written) {
+		value->shared = true;
+	}
+}
+
+/* marks what stays in the frame and what is only read, loop is true inside of one */
+static void escape_frame(Node *node, EscapeMethod *method, bool loop) {
+	if(!node) {
+		return;
+	}
+
+	switch(node->type) {
+		case ND_ASSIGN: {
+			Node *left = node->left;
+			if(escape_local(left) && left->offset < method->locals && !method->escapes[left->offset]) {
+				escape_place(node->right, method->writes[left->offset], loop);
+			}
+		}
+		break;
+		case ND_MEMBER:
+		case ND_ARRAYMEMBER: {
+			escape_place(node->body, false, true);
+		}
+		break;
+		case ND_CALL:
+		case ND_NEW:
+		case ND_SYSCALL: {
+			if(node->args) {
+				int index = 0;
+				for(ListNode *it = list_begin(&node->args->bodylist); it != list_end(&node->args->bodylist); it = list_next(it), index++) {
+					EscapeUse use = escape_use(node, index);
+					if(!use.escapes) {
+						escape_place((Node*)it, use.written, loop);
+					}
+				}
+			}
+		}
+		break;
+		case ND_WHILE:
+		case ND_FOR: {
+			escape_frame(node->init, method, loop);
+			escape_frame(node->condition, method, true);
+			escape_frame(node->body, method, true);
+			escape_frame(node->increment, method, true);
+			return;
+		}
+		break;
+	}
+
+	/* the target of a store is not read */
+	if(node->type == ND_ASSIGN && node->left->type != ND_VARIABLE) {
+		escape_frame(node->left->body, method, loop);
+		escape_frame(node->left->index, method, loop);
+	} else {
+		escape_frame(node->left, method, loop);
+	}
+
+	escape_frame(node->right, method, loop);
+	escape_frame(node->body, method, loop);
+	escape_frame(node->args, method, loop);
+	escape_frame(node->index, method, loop);
+	escape_frame(node->alternate, method, loop);
+	escape_frame(node->condition, method, loop);
+
+	for(ListNode *it = list_begin(&node->bodylist); it != list_end(&node->bodylist); it = list_next(it)) {
+		escape_frame((Node*)it, method, loop);
+	}
+}
+
+void escape(Node *program) {
+	method_count = 0;
+	escape_collect(program);
+
+	do {
+		changed = false;
+		for(int m = 0; m < method_count; m++) {
+			for(ListNode *it = list_begin(&methods[m].node->bodylist); it != list_end(&methods[m].node->bodylist); it = list_next(it)) {
+				escape_walk((Node*)it, &methods[m]);
+			}
+		}
+	} while(changed);
+
+	for(int m = 0; m < method_count; m++) {
+		for(ListNode *it = list_begin(&methods[m].node->bodylist); it != list_end(&methods[m].node->bodylist); it = list_next(it)) {
+			escape_frame((Node*)it, &methods[m], false);
+		}
+	}
+
+	for(int m = 0; m < method_count; m++) {
+		free(methods[m].escapes);
+		free(methods[m].writes);
+	}
+	free(methods);
+
+	methods      = NULL;
+	method_count = 0;
+	method_size  = 0;
+}
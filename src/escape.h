@@ -0,0 +1,8 @@
+#ifndef ESCAPE_H
+#define ESCAPE_H
+
+#include "parse.h"
+
+void              escape(Node *program);
+
+#endif
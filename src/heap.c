@@ -0,0 +1,266 @@
+#define _DEFAULT_SOURCE /* MAP_ANONYMOUS */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "heap.h"
+
+/*
+	Chip object heap
+
+	the sweep walks every chunk block by block from its data up to its
+	top, so a block is never taken out of a chunk, only marked free. 
+	chunks are mapped straight from the system so the memory of one 
+	that is released goes back at once
+*/
+
+HeapChunk *heap_chunks = NULL;
+
+/* bytes in blocks handed out and not freed */
+size_t heap_in_use = 0;
+
+static HeapChunk *current = NULL;
+
+/* free blocks by size in 16 byte steps, linked through OBJECT_LINK */
+static Object *free_lists[HEAP_CLASSES];
+
+static HeapChunk *heap_new_chunk(size_t size, bool large) {
+	size_t     mapped = HEAP_ALIGN(sizeof(HeapChunk)) + size;
+	HeapChunk *chunk  = mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(chunk == MAP_FAILED) {
+		printf("out of memory\n");
+		exit(1);
+	}
+
+	chunk->top      = HEAP_CHUNK_DATA(chunk);
+	chunk->end      = chunk->top + size;
+	chunk->mapped   = mapped;
+	chunk->large    = large;
+	chunk->previous = NULL;
+	chunk->next     = heap_chunks;
+
+	if(heap_chunks) {
+		heap_chunks->previous = chunk;
+	}
+	heap_chunks = chunk;
+
+	return chunk;
+}
+
+static void heap_unlink(HeapChunk *chunk) {
+	if(chunk->previous) {
+		chunk->previous->next = chunk->next;
+	} else {
+		heap_chunks = chunk->next;
+	}
+	if(chunk->next) {
+		chunk->next->previous = chunk->previous;
+	}
+}
+
+/* a block from the top of the current chunk, never from a free list */
+static Object *heap_bump(size_t block) {
+	if(!current || current->top + block > current->end) {
+		current = heap_new_chunk(HEAP_CHUNK_SIZE, false);
+	}
+
+	Object *o = (Object*)current->top;
+	current->top += block;
+
+	return o;
+}
+
+/*
+	slots, array and the mark are left for the caller to fill in, the 
+	slots are only cleared of references. a block is never smaller 
+	than HEAP_MIN_BLOCK so it can be linked once it is free
+*/
+
+Object *heap_alloc(int slots, size_t bytes, bool is_array) {
+	size_t  block = HEAP_ALIGN(sizeof(Object) + sizeof(Slot) * slots + bytes);
+	Object *o;
+
+	if(block < HEAP_MIN_BLOCK) {
+		block = HEAP_MIN_BLOCK;
+	}
+
+	if(block > HEAP_LARGE) {
+		HeapChunk *chunk = heap_new_chunk(block, true);
+		o = (Object*)chunk->top;
+		chunk->top += block;
+	} else if(free_lists[block / 16]) {
+		o = free_lists[block / 16];
+		free_lists[block / 16] = OBJECT_LINK(o);
+	} else {
+		o = heap_bump(block);
+	}
+
+	heap_in_use += block;
+
+	o->block     = block;
+	o->is_free   = false;
+	o->is_moved  = false;
+	o->has_refs  = false;
+	o->is_array  = is_array;
+	o->size      = slots;
+	o->type      = 1;
+
+	for(int x = 0; x < slots; x++) {
+		OBJECT_VARLIST(o)[x].is_ref = false;
+	}
+
+	return o;
+}
+
+void heap_free(Object *object) {
+	heap_in_use -= object->block;
+
+	if(object->block > HEAP_LARGE) {
+		HeapChunk *chunk = (HeapChunk*)((char*)object - HEAP_ALIGN(sizeof(HeapChunk)));
+
+		heap_unlink(chunk);
+		munmap(chunk, chunk->mapped);
+		return;
+	}
+
+	object->is_free     = true;
+	OBJECT_LINK(object) = free_lists[object->block / 16];
+
+	free_lists[object->block / 16] = object;
+}
+
+/*
+	frees every block of the chunk whose mark is not marked into the 
+	sweep, a large chunk is only noted as it can not be unlinked yet
+*/
+
+void heap_sweep_chunk(HeapChunk *chunk, bool marked, HeapSweep *sweep) {
+	char *block = HEAP_CHUNK_DATA(chunk);
+	while(block < chunk->top) {
+		Object *object = (Object*)block;
+		block += object->block;
+
+		if(object->is_free || object->is_marked == marked) {
+			continue;
+		}
+
+		sweep->objects++;
+
+		if(chunk->large) {
+			if(sweep->large_count == sweep->large_size) {
+				sweep->large_size = sweep->large_size ? sweep->large_size * 2 : 16;
+				sweep->large = realloc(sweep->large, sizeof(HeapChunk*) * sweep->large_size);
+				if(!sweep->large) {
+					printf("out of memory\n");
+					exit(1);
+				}
+			}
+			sweep->large[sweep->large_count++] = chunk;
+			continue;
+		}
+
+		int size_class = object->block / 16;
+
+		object->is_free     = true;
+		OBJECT_LINK(object) = sweep->free_head[size_class];
+
+		if(!sweep->free_head[size_class]) {
+			sweep->free_tail[size_class] = object;
+		}
+		sweep->free_head[size_class] = object;
+		sweep->bytes += object->block;
+	}
+}
+
+void heap_merge(HeapSweep *sweep) {
+	for(int c = 0; c < HEAP_CLASSES; c++) {
+		if(sweep->free_head[c]) {
+			OBJECT_LINK(sweep->free_tail[c]) = free_lists[c];
+			free_lists[c] = sweep->free_head[c];
+		}
+	}
+
+	heap_in_use -= sweep->bytes;
+
+	for(int l = 0; l < sweep->large_count; l++) {
+		heap_free((Object*)HEAP_CHUNK_DATA(sweep->large[l]));
+	}
+
+	free(sweep->large);
+}
+
+/*
+	moves every block in use out of the small chunks that are at most 
+	percent full into the current chunk and new ones. a moved object 
+	has is_moved set and its new address in OBJECT_LINK, references to it 
+	are to be updated before heap_release unmaps the chunks returned
+*/
+
+HeapChunk *heap_evacuate(int percent) {
+	HeapChunk *evacuated = NULL;
+
+	HeapChunk *chunk = heap_chunks;
+	while(chunk) {
+		HeapChunk *next = chunk->next;
+
+		if(!chunk->large && chunk != current) {
+			size_t used = 0;
+			for(char *block = HEAP_CHUNK_DATA(chunk); block < chunk->top; block += ((Object*)block)->block) {
+				if(!((Object*)block)->is_free) {
+					used += ((Object*)block)->block;
+				}
+			}
+
+			if(used * 100 <= (size_t)(chunk->end - HEAP_CHUNK_DATA(chunk)) * percent) {
+				heap_unlink(chunk);
+				chunk->next = evacuated;
+				evacuated   = chunk;
+			}
+		}
+
+		chunk = next;
+	}
+
+	if(!evacuated) {
+		return NULL;
+	}
+
+	/* the free lists run through the evacuated chunks too, they are built again */
+	memset(free_lists, 0, sizeof(free_lists));
+
+	for(chunk = heap_chunks; chunk; chunk = chunk->next) {
+		for(char *block = HEAP_CHUNK_DATA(chunk); block < chunk->top; block += ((Object*)block)->block) {
+			Object *object = (Object*)block;
+			if(object->is_free) {
+				OBJECT_LINK(object) = free_lists[object->block / 16];
+				free_lists[object->block / 16] = object;
+			}
+		}
+	}
+
+	for(chunk = evacuated; chunk; chunk = chunk->next) {
+		for(char *block = HEAP_CHUNK_DATA(chunk); block < chunk->top; block += ((Object*)block)->block) {
+			Object *object = (Object*)block;
+			if(object->is_free) {
+				continue;
+			}
+
+			Object *to = heap_bump(object->block);
+			memcpy(to, object, object->block);
+
+			object->is_moved    = true;
+			OBJECT_LINK(object) = to;
+		}
+	}
+
+	return evacuated;
+}
+
+void heap_release(HeapChunk *chunks) {
+	while(chunks) {
+		HeapChunk *next = chunks->next;
+		munmap(chunks, chunks->mapped);
+		chunks = next;
+	}
+}
@@ -0,0 +1,63 @@
+#ifndef HEAP_H
+#define HEAP_H
+
+#include <stddef.h>
+#include "intepreter.h"
+
+/*
+	objects are carved out of large chunks with a bump pointer, header,
+	slots and array payload in one block. freed blocks go on a free
+	list per block size and are handed out again before the chunk
+	grows, blocks over HEAP_LARGE get a chunk of their own. chunks 
+	that are mostly free can be emptied by moving their objects 
+	elsewhere (see heap_evacuate)
+*/
+
+#define HEAP_ALIGN(n) (((n) + 15) & ~(size_t)15)
+
+#define HEAP_CHUNK_SIZE (1024 * 1024)
+#define HEAP_LARGE (64 * 1024)
+
+/* header and the link of a free block */
+#define HEAP_MIN_BLOCK HEAP_ALIGN(sizeof(Object) + sizeof(Object*))
+
+typedef struct _HeapChunk {
+	struct _HeapChunk *next;
+	struct _HeapChunk *previous;
+	char *top;
+	char *end;
+	size_t mapped;
+	bool large;
+} HeapChunk;
+
+#define HEAP_CHUNK_DATA(chunk) ((char*)(chunk) + HEAP_ALIGN(sizeof(HeapChunk)))
+
+#define HEAP_CLASSES (HEAP_LARGE / 16 + 1)
+
+/*
+	dead blocks one sweeper found in its chunks, it only links them 
+	up so sweepers can run side by side. heap_merge hands them to the 
+	heap once all are done
+*/
+
+typedef struct {
+	Object *free_head[HEAP_CLASSES];
+	Object *free_tail[HEAP_CLASSES];
+	HeapChunk **large;
+	int large_count;
+	int large_size;
+	size_t bytes;
+	int objects;
+} HeapSweep;
+
+extern HeapChunk *heap_chunks;
+extern size_t     heap_in_use;
+
+Object           *heap_alloc(int slots, size_t bytes, bool is_array);
+void              heap_free(Object *object);
+void              heap_sweep_chunk(HeapChunk *chunk, bool marked, HeapSweep *sweep);
+void              heap_merge(HeapSweep *sweep);
+HeapChunk        *heap_evacuate(int percent);
+void              heap_release(HeapChunk *chunks);
+
+#endif
@@ -6,642 +6,815 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
-#include <netdb.h>
 #include <math.h>
-#include <netinet/in.h>
-#include <sys/socket.h>
-#include <sys/types.h>
 #include <arpa/inet.h>
 #include <signal.h>
 #include <unistd.h>
 #include <stdint.h>
 #include <time.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "chip.h"
 #include "list.h"
 #include "optimize.h"
 #include "intepreter.h"
+#include "verify.h"
+#include "profile.h"
+#include "jit.h"
+#include "runtime.h"
+
+char *constant_pool = NULL;
+int64_t constant_count = 0;
+int64_t constant_pool_size = 0;
+Instruction *codes;
+int code_size = 0;
 
-List objects;
+Method *methods;
+int method_count = 0;
 
-static char *constants[8192] = {};
-static char *codes;
-int code_size = 0;
+/*
+	a constant that would reach outside of the pool, or a load of one 
+	that is not there, is refused before anything uses the pool
+*/
+
+static void load_constants() {
+	if(constant_count < 0 || constant_pool_size < 0 || 
+		constant_pool_size % CONST_ALIGN || 
+		(uint64_t)constant_count > (uint64_t)constant_pool_size / sizeof(uint64_t)) {
+		printf("invalid constant pool\n");
+		exit(1);
+	}
+
+	for(int64_t c = 0; c < constant_count; c++) {
+		uint64_t offset = NTOHLL(((uint64_t*)constant_pool)[c]);
+		if(offset % CONST_ALIGN || offset > constant_pool_size - CONST_HEADER) {
+			printf("invalid constant %li\n", c);
+			exit(1);
+		}
+
+		uint64_t length = NTOHLL(*(uint64_t*)(constant_pool + offset + CONST_HEADER / 2));
+		if(length >= constant_pool_size - offset - CONST_HEADER || length > INT32_MAX - 1) {
+			printf("invalid constant %li\n", c);
+			exit(1);
+		}
+	}
+
+	for(int pc = 0; pc < code_size; pc++) {
+		if((codes[pc].op == OP_LOAD_CONST || codes[pc].op == OP_LOAD_CONST_SHARED) && 
+			(codes[pc].left < 0 || codes[pc].left >= constant_count)) {
+			printf("constant %li out of range at %i\n", (int64_t)codes[pc].left, pc);
+			exit(1);
+		}
+	}
+}
+
+/*
+	the file is mapped whole and private, the code is decoded straight 
+	from it and the constant pool is used where it is. the mapping 
+	stays for the life of the program
+*/
 
 int load_file(const char *name) {
-	FILE *fp = fopen(name, "rb");
-	if(!fp) {
+	int fd = open(name, O_RDONLY);
+	if(fd < 0) {
 		printf("unable to load file %s\n", name);
 		exit(1);
 	}
 
-	chip_hdr_t hdr;
-	if(fread(&hdr, sizeof(hdr), 1, fp) != 1) {
+	struct stat st;
+	if(fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(chip_hdr_t)) {
 		printf("unable to read file\n");
 		exit(1);
 	}
 
-	code_size = NTOHLL(hdr.code_size);
-	codes     = malloc(sizeof(char) * code_size);
+	char *file = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	if(file == MAP_FAILED) {
+		printf("unable to read file\n");
+		exit(1);
+	}
+
+	close(fd);
 
-	if(NTOHL(hdr.version) != CHIP_VERSION) {
+	chip_hdr_t *hdr = (chip_hdr_t*)file;
+
+	if(memcmp(hdr->magic, CHIP_MAGIC, sizeof(CHIP_MAGIC)) != 0) {
+		printf("%s is not a chip executable\n", name);
+		exit(1);
+	}
+
+	if(NTOHL(hdr->version) != CHIP_VERSION) {
 		printf("incorrect chip executable version\n");
 		exit(1);
 	}
 
-	for(int i = 0; i < code_size; i++) {
-		if(fread(&codes[i], sizeof(char), 1, fp) != 1) {
-			printf("unable to read file\n");
-			exit(1);
-		}
+	uint64_t byte_size = NTOHLL(hdr->code_size);
+	uint64_t pool      = CONST_PAGE_ROUND(sizeof(chip_hdr_t) + byte_size);
+
+	constant_count     = NTOHLL(hdr->const_size);
+	constant_pool_size = NTOHLL(hdr->pool_size);
+
+	if(byte_size > INT32_MAX || pool > (uint64_t)st.st_size || 
+		(uint64_t)constant_pool_size > (uint64_t)st.st_size - pool) {
+		printf("unable to read file\n");
+		exit(1);
 	}
 
-	for(int z = 0; z < NTOHLL(hdr.const_size); z++) {
-		int constant_length = 0;
-		if(fread(&constant_length, sizeof(constant_length), 1, fp) != 1) {
-			printf("unable to read file\n");
-			exit(1);
-		}
+	int entry = predecode(file + sizeof(chip_hdr_t), byte_size, NTOHLL(hdr->entry));
 
-		char constant_data[constant_length + 1];
-		memset(constant_data, 0, sizeof(constant_data));
+	methods = verify(codes, code_size, entry, &method_count);
 
-		if(fread(&constant_data, sizeof(char), constant_length, fp) != constant_length) {
-			printf("unable to read file\n");
-			exit(1);
-		}
+#ifdef CHIP_JIT
+	jit_init(codes, code_size, methods, method_count);
+#endif
 
-		constant_data[sizeof(constant_data) - 1] = '\0';
+	constant_pool = file + pool;
 
-		SET_CONST(z, strdup(constant_data));
-	}
+	load_constants();
 
-	fclose(fp);
+	return entry;
+}
 
-	return NTOHLL(hdr.entry);
+bool op_is_jump(uint8_t op) {
+	switch(op) {
+		case OP_JE:
+		case OP_JMP:
+		case OP_CALL:
+		case OP_JZ:
+		case OP_JZ_LOCAL:
+		case OP_CMPEQ_JZ:
+		case OP_CMPGT_JZ:
+		case OP_CMPLT_JZ: {
+			return true;
+		}
+		break;
+	}
+	return false;
 }
 
-int allocs = 0;
+/*
+	decodes one packed instruction at pc into ins, returns the pc of 
+	the next one
+*/
 
-Object *new_object(int size) {
-	Object *o = malloc(sizeof(Object));
-	o->array = NULL;
-	o->varlist = malloc(sizeof(Slot) * size);
-	o->size = size;
-	o->type = 1;
-	o->is_marked = false;
+static int decode(char *bytes, int byte_size, int pc, Instruction *ins) {
+	uint8_t op      = (uint8_t)bytes[pc++];
+	int64_t values[3] = {0, 0, 0};
 
-	for(int x = 0; x < size; x++) {
-		o->varlist[x].is_ref = false;
+	if(op >= sizeof(op_size) / sizeof(op_size[0])) {
+		printf("illegal instruction %i at %i\n", op, pc - 1);
+		exit(1);
 	}
 
-	list_insert(list_end(&objects), o);
+	int oprands = op_size[op];
+
+	if(oprands > 0) {
+		if(pc >= byte_size) {
+			printf("truncated instruction at %i\n", pc - 1);
+			exit(1);
+		}
+
+		uint8_t widths = (uint8_t)bytes[pc++];
+
+		for(int o = 0; o < oprands; o++) {
+			int width = (widths >> (o * 2)) & 0x03;
+
+			if(pc + (1 << width) > byte_size) {
+				printf("truncated instruction at %i\n", pc);
+				exit(1);
+			}
+
+			uint64_t raw = 0;
+			for(int b = 0; b < (1 << width); b++) {
+				raw = (raw << 8) | (uint8_t)bytes[pc + b];
+			}
 
-	allocs++;
+			/* sign extend from the oprand width */
+			int shift = 64 - (8 << width);
+			values[o] = shift ? ((int64_t)(raw << shift) >> shift) : (int64_t)raw;
 
-	return o;
+			pc += 1 << width;
+		}
+	}
+
+	ins->op    = op;
+	ins->left  = values[0];
+	ins->right = (int32_t)values[1];
+	ins->dest  = (uint16_t)values[2];
+
+	return pc;
 }
 
-void free_object(Object *object) {
-	if(object->array) {
-		free(object->array);
+/*
+	translates the packed big-endian bytecode into fixed width 
+	instructions with native oprands, jump targets become instruction 
+	indices. returns the index of the entry point
+*/
+
+int predecode(char *bytes, int byte_size, int entry) {
+	int *index = malloc(sizeof(int) * (byte_size + 1));
+	for(int i = 0; i <= byte_size; i++) {
+		index[i] = -1;
 	}
 
-	free(object->varlist);
+	Instruction ins;
 
-	list_remove(&object->node);
-	free(object);
+	code_size = 0;
+	for(int pc = 0; pc < byte_size; code_size++) {
+		index[pc] = code_size;
+		pc = decode(bytes, byte_size, pc, &ins);
+	}
 
-	allocs--;
+	if(entry < 0 || entry >= byte_size || index[entry] < 0) {
+		printf("invalid entry point %i\n", entry);
+		exit(1);
+	}
 
-	// printf("OBJECTS STILL REFRENCED: %i %li\n\n", allocs, list_size(&objects));
-}
+	codes = malloc(sizeof(Instruction) * code_size);
 
-void gc(Slot *stack, int size) {
-	mark(stack, size);
-	sweep();
-}
+	for(int pc = 0, i = 0; pc < byte_size; i++) {
+		pc = decode(bytes, byte_size, pc, &codes[i]);
 
-void mark(Slot *stack, int size) {
-	for(int y = 0; y < size; y++) {
-		Slot s = stack[y];
-		if(s.is_ref) {
-			Object *o = s.ref;
-			if(!o->is_marked) {
-				o->is_marked = true;
-				mark(o->varlist, o->size);
+		if(op_is_jump(codes[i].op)) {
+			int64_t target = codes[i].left;
+			if(target < 0 || target >= byte_size || index[target] < 0) {
+				printf("invalid jump target %li at %i\n", target, i);
+				exit(1);
 			}
+			codes[i].left = index[target];
 		}
 	}
-}
 
-void sweep() {
-	ListNode *i = list_begin(&objects);
-	while(i != list_end(&objects)) {
-		Object *object = (Object*)i;
-		i = list_next(i);
+	entry = index[entry];
 
-		if(!object->is_marked) {
-			free_object(object);
-		}
+	free(index);
 
-		object->is_marked = false;
-	}
+	return entry;
 }
 
-int64_t eval(int pc) {
-	clock_t begin;
+/*
+	loads the predecoded op at pc and advances pc
+*/
+
+#define FETCH() ({ \
+	ins  = &program[pc++]; \
+	op   = ins->op; \
+	left = ins->left; \
+	PROFILE_OP(op); \
+})
+
+/*
+	with labels-as-values every op jumps straight to the handler of the 
+	next one instead of going back through a single switch. the verifier 
+	guarantees control never runs off the end of the code
+*/
+
+#ifdef CHIP_THREADED_DISPATCH
+# define DISPATCH() ({ FETCH(); goto *dispatch[op]; })
+# define SWITCH(op)
+# define CASE(name) do_##name:
+# define DEFAULT() do_illegal:
+# define NEXT() DISPATCH()
+#else
+# define DISPATCH() ({ FETCH(); })
+# define SWITCH(op) switch(op)
+# define CASE(name) case name:
+# define DEFAULT() default:
+# define NEXT() continue
+#endif
+
+/*
+	continues in compiled code when pc has some, hot also counts pc 
+	towards getting its method compiled. compiled code hands back the 
+	pc of the first op it cannot run
+*/
 
+#ifdef CHIP_JIT
+# define JIT_ENTER(hot) ({ \
+	if(jit_native[pc] || ((hot) && jit_hot(pc))) { \
+		int64_t top = sp; \
+		pc = jit_run(stack, vp, &top, pc); \
+		sp = top; \
+	} \
+})
+#else
+# define JIT_ENTER(hot) ((void)0)
+#endif
+
+int64_t eval(int pc) {
 	/* stack */
-	Slot stack[128 * 1024] = {0};
+	Slot *stack = runtime_stack();
 	/* var pointer */
 	int64_t vp = 0;
 	/* stack pointer */
-	int64_t sp = 65535;
+	int64_t sp = STACK_BASE;
+	/* slots of the current frame */
+	int locals = methods[0].locals;
+	/* the callers, every frame is at least one slot */
+	Frame *frames = malloc(sizeof(Frame) * STACK_BASE);
+	int64_t fp = 0;
+
+	if(!frames) {
+		printf("out of memory\n");
+		exit(1);
+	}
 
-	while(pc < code_size) {
-		uint8_t op      = (codes[pc] >> 2) & 0x3F;
-		uint8_t width   = (codes[pc] >> 0) & 0x03;
-		int64_t left    = 0;
+	Instruction *program = codes;
+	Instruction *ins     = NULL;
 
-		pc++;
+	runtime_enter(stack, vp, locals);
 
-		if(op_size[op]) {
-			left = *(int64_t*)&codes[pc];
-			if(width == 0) {
-				left = (left) & 0xFF;
-			}
-			if(width == 1) {
-				left = NTOHS(left & 0xFFFF);
-			}
-			if(width == 2) {
-				left = NTOHL(left & 0xFFFFFFFF);
-			}
-			if(width == 3) {
-				left = NTOHLL(left & 0xFFFFFFFFFFFFFFFF);
-			}
-			pc += 1 << width;
-		}
+	uint8_t op   = 0;
+	int64_t left = 0;
+
+#ifdef CHIP_THREADED_DISPATCH
+	#define DEFINE_OP(name, display, oprands, pops, pushes) [name] = &&do_##name,
+	static void *dispatch[256] = {
+		[0 ... 255] = &&do_illegal,
+		LIST_OF_OPS
+	};
+	#undef DEFINE_OP
+#endif
 
-		switch(op) {
-			case OP_NOP: {
+	for(;;) {
+		DISPATCH();
+
+		SWITCH(op) {
+			CASE(OP_NOP) {
 				
 			}
-			break;
-			case OP_LOAD: {
+			NEXT();
+			CASE(OP_LOAD) {
 				Slot var = GET_VAR_SLOT(left);
 				PUSH_STACK_SLOT(var);
 			}
-			break;
-			case OP_LOAD_0:
-			case OP_LOAD_1:
-			case OP_LOAD_2:
-			case OP_LOAD_3:
-			case OP_LOAD_4:
-			case OP_LOAD_5: {
+			NEXT();
+			CASE(OP_LOAD_0)
+			CASE(OP_LOAD_1)
+			CASE(OP_LOAD_2)
+			CASE(OP_LOAD_3)
+			CASE(OP_LOAD_4)
+			CASE(OP_LOAD_5) {
 				Slot var = GET_VAR_SLOT(op - OP_LOAD_0);
 				PUSH_STACK_SLOT(var);
 			}
-			break;
-			case OP_STORE: {
+			NEXT();
+			CASE(OP_STORE) {
 				Slot var = POP_STACK_SLOT();
 				SET_VAR_SLOT(left, var);
 			}
-			break;
-			case OP_STORE_0:
-			case OP_STORE_1:
-			case OP_STORE_2:
-			case OP_STORE_3:
-			case OP_STORE_4:
-			case OP_STORE_5: {
+			NEXT();
+			CASE(OP_STORE_0)
+			CASE(OP_STORE_1)
+			CASE(OP_STORE_2)
+			CASE(OP_STORE_3)
+			CASE(OP_STORE_4)
+			CASE(OP_STORE_5) {
 				Slot var = POP_STACK_SLOT();
 				SET_VAR_SLOT(op - OP_STORE_0, var);
 			}
-			break;
-			case OP_DUP: {
+			NEXT();
+			CASE(OP_DUP) {
 				Slot s = TOP_STACK_SLOT();
 				PUSH_STACK_SLOT(s);
 			}
-			break;
-			case OP_PUSH: {
+			NEXT();
+			CASE(OP_PUSH) {
 				PUSH_STACK((int64_t)left);
 			}
-			break;
-			case OP_PUSH_0:
-			case OP_PUSH_1:
-			case OP_PUSH_2:
-			case OP_PUSH_3:
-			case OP_PUSH_4:
-			case OP_PUSH_5: {
+			NEXT();
+			CASE(OP_PUSH_0)
+			CASE(OP_PUSH_1)
+			CASE(OP_PUSH_2)
+			CASE(OP_PUSH_3)
+			CASE(OP_PUSH_4)
+			CASE(OP_PUSH_5) {
 				PUSH_STACK((int64_t)op - OP_PUSH_0);
 			}
-			break;
-			case OP_LOAD_CONST: {			
-				char *str  = GET_CONST(left);
-				int   size = strlen(str);
-
-				Object *o = new_object(size + 1);
-				o->array = malloc(sizeof(char) * size);
-
-				memcpy(o->array, str, size);
+			NEXT();
+			CASE(OP_LOAD_CONST) {
+				SYNC_ROOTS();
 
-				o->type = sizeof(char);
-
-				o->varlist[0].is_ref = false;
-				o->varlist[0].value  = size;
-                                                                                                                          
+				Object *o = runtime_load_const(left);
 				PUSH_STACK_OBJECT(o);
 			}
-			break;
-			case OP_LOAD_FIELD: {
+			NEXT();
+			CASE(OP_LOAD_CONST_SHARED) {
+				PUSH_STACK_SLOT(((Slot){ .is_ref = false, .ref = constant_objects[left] }));
+			}
+			NEXT();
+			CASE(OP_LOAD_FIELD) {
 				Object *instance = POP_STACK_OBJECT();
-				Slot var = instance->varlist[left];
+				Slot var = OBJECT_VARLIST(instance)[left];
 				PUSH_STACK_SLOT(var);
 			}
-			break;
-			case OP_STORE_FIELD: {
+			NEXT();
+			CASE(OP_STORE_FIELD) {
 				Object *instance = POP_STACK_OBJECT();
 				Slot var = POP_STACK_SLOT();
-				instance->varlist[left] = var;
+				runtime_store_field(instance, left, var);
 			}
-			break;
-			case OP_POP: {
+			NEXT();
+			CASE(OP_POP) {
 				POP_STACK_OBJECT();
 			}
-			break;
-			case OP_CMPEQ: {
+			NEXT();
+			CASE(OP_CMPEQ) {
 				int64_t a = POP_STACK();
 				int64_t b = POP_STACK();
 				int64_t c = b == a;
 				PUSH_STACK(c);
 			}
-			break;
-			case OP_CMPGT: {
+			NEXT();
+			CASE(OP_CMPGT) {
 				int64_t a = POP_STACK();
 				int64_t b = POP_STACK();
 				int64_t c = b > a;
 				PUSH_STACK(c);
 			}
-			break;
-			case OP_CMPLT: {
+			NEXT();
+			CASE(OP_CMPLT) {
 				int64_t a = POP_STACK();
 				int64_t b = POP_STACK();
 				int64_t c = b < a;
 				PUSH_STACK(c);
 			}
-			break;
-			case OP_SHR: {
+			NEXT();
+			CASE(OP_SHR) {
 				int64_t a = POP_STACK();
 				int64_t b = POP_STACK();
 				int64_t c = b >> a;
 				PUSH_STACK(c);
 			}
-			break;
-			case OP_SHL: {
+			NEXT();
+			CASE(OP_SHL) {
 				int64_t a = POP_STACK();
 				int64_t b = POP_STACK();
 				int64_t c = b << a;
 				PUSH_STACK(c);
 			}
-			break;
-			case OP_ADD: {
+			NEXT();
+			CASE(OP_ADD) {
 				int64_t a = POP_STACK();
 				int64_t b = POP_STACK();
 				int64_t c = b + a;
 				PUSH_STACK(c);
 			}
-			break;
-			case OP_SUB: {
+			NEXT();
+			CASE(OP_SUB) {
 				int64_t a = POP_STACK();
 				int64_t b = POP_STACK();
 				int64_t c = b - a;
 				PUSH_STACK(c);
 			}
-			break;
-			case OP_MUL: {
+			NEXT();
+			CASE(OP_MUL) {
 				int64_t a = POP_STACK();
 				int64_t b = POP_STACK();
 				int64_t c = b * a;
 				PUSH_STACK(c);
 			}
-			break;
-			case OP_DIV: {
+			NEXT();
+			CASE(OP_DIV) {
 				int64_t a = POP_STACK();
 				int64_t b = POP_STACK();
 				int64_t c = b / a;
 				PUSH_STACK(c);
 			}
-			break;
-			case OP_NEG: {
+			NEXT();
+			CASE(OP_NEG) {
 				int64_t a = POP_STACK();
 				PUSH_STACK(-a);
 			}
-			break;
-			case OP_NOT: {
+			NEXT();
+			CASE(OP_NOT) {
 				int64_t a = POP_STACK();
 				PUSH_STACK(~a);
 			}
-			break;
-			case OP_OR: {
+			NEXT();
+			CASE(OP_OR) {
 				int64_t a = POP_STACK();
 				int64_t b = POP_STACK();
 				PUSH_STACK(a | b);
 			}
-			break;
-			case OP_XOR: {
+			NEXT();
+			CASE(OP_XOR) {
 				int64_t a = POP_STACK();
 				int64_t b = POP_STACK();
 				PUSH_STACK(a ^ b);
 			}
-			break;
-			case OP_AND: {
+			NEXT();
+			CASE(OP_AND) {
 				int64_t a = POP_STACK();
 				int64_t b = POP_STACK();
 				PUSH_STACK(a & b);
 			}
-			break;
-			case OP_MOD: {
+			NEXT();
+			CASE(OP_MOD) {
 				int64_t a = POP_STACK();
 				int64_t b = POP_STACK();
 				int64_t c = b % a;
 				PUSH_STACK(c);
 			}
-			break;
-			case OP_FADD: {
+			NEXT();
+			CASE(OP_FADD) {
 				double a = POP_STACK_DOUBLE();
 				double b = POP_STACK_DOUBLE();
 				double c = b + a;
 				PUSH_STACK_DOUBLE(c);
 			}
-			break;
-			case OP_FSUB: {
+			NEXT();
+			CASE(OP_FSUB) {
 				double a = POP_STACK_DOUBLE();
 				double b = POP_STACK_DOUBLE();
 				double c = b - a;
 				PUSH_STACK_DOUBLE(c);
 			}
-			break;
-			case OP_FMUL: {
+			NEXT();
+			CASE(OP_FMUL) {
 				double a = POP_STACK_DOUBLE();
 				double b = POP_STACK_DOUBLE();
 				double c = b * a;
 				PUSH_STACK_DOUBLE(c);
 			}
-			break;
-			case OP_FDIV: {
+			NEXT();
+			CASE(OP_FDIV) {
 				double a = POP_STACK_DOUBLE();
 				double b = POP_STACK_DOUBLE();
 				double c = b / a;
 				PUSH_STACK_DOUBLE(c);
 			}
-			break;
-			case OP_FNEG: {
+			NEXT();
+			CASE(OP_FNEG) {
 				double a = POP_STACK_DOUBLE();
 				PUSH_STACK_DOUBLE(-a);
 			}
-			break;
-			case OP_FMOD: {
+			NEXT();
+			CASE(OP_FMOD) {
 				double a = POP_STACK_DOUBLE();
 				double b = POP_STACK_DOUBLE();
 				double c = fmod(a, b);
 				PUSH_STACK_DOUBLE(c);
 			}
-			break;
-			case OP_I2F: {
+			NEXT();
+			CASE(OP_I2F) {
 				int64_t a = POP_STACK();
 				double  b = (double)a;
 				PUSH_STACK_DOUBLE(b);
 			}
-			break;
-			case OP_CALL: {
-				int64_t arg_length = POP_STACK();
+			NEXT();
+			CASE(OP_CALL) {
+				Method *method = &methods[ins->right];
 
-				Slot args[arg_length];
-				for(int i = 0; i < arg_length; i++) {
-					args[i] = POP_STACK_SLOT();
+				if(sp - (method->arg_count + 1) + method->max_stack > STACK_MAX) {
+					printf("stackoverflow, sp = %li\n", sp);
+					exit(1);
 				}
-				Slot instance = POP_STACK_SLOT();
 
-				PUSH_FRAME(); 
+				if(vp + locals + method->locals > STACK_BASE) {
+					printf("frameoverflow, vp = %li\n", vp);
+					exit(1);
+				}
 
-				PUSH_STACK(pc);
+				frames[fp++] = (Frame){ .vp = vp, .pc = pc, .locals = locals, .local_top = local_top };
 
-				PUSH_STACK_SLOT(instance);
-				for(int i = 0; i < arg_length; i++) {
-					PUSH_STACK_SLOT(args[i]);
-				}
+				vp    += locals;
+				locals = method->locals;
+
+				sp = runtime_call(stack, vp, sp, method->arg_count + 1, locals);
 
 				pc = (uint32_t)left;
 
-				continue;
-			}
-			break;
-			case OP_SYSCALL: {
-				int name = (int)POP_STACK();
-
-				if(name == 1) {
-					int64_t arg = POP_STACK();
-					printf("%li\n", arg);
-
-					PUSH_STACK(0);
-				} else if(name == 2000) {
-					Object *arg = POP_STACK_OBJECT();
-
-					for(int i = 0; i < 32; i++) {
-						printf("%02x\n", arg->array[i] & 0xff);
-					}
-
-					PUSH_STACK(0);
-				} else if(name == 8000) {
-					Object  *dst        = POP_STACK_OBJECT();
-					int64_t  dst_offset = POP_STACK();
-					Object  *src        = POP_STACK_OBJECT();
-					int64_t  src_offset = POP_STACK();
-					int64_t  b          = POP_STACK();
-
-					memcpy(dst->array + (dst_offset * src->type), src->array + (src_offset * src->type), b * src->type);
-
-					PUSH_STACK(0);
-				} else if(name == 2) {
-					int64_t arg = POP_STACK();
-					printf("%c", (char)arg);
-
-					PUSH_STACK(0);
-				} else if(name == 5) {
-					Object *arg = POP_STACK_OBJECT();
-					free_object(arg);
-					PUSH_STACK(0);
-				} else if(name == 60) {
-					int sockfd = socket(AF_INET, SOCK_STREAM, 0);
-
-					setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &(int){1}, sizeof(int));
-
-					PUSH_STACK(sockfd);
-				} else if(name == 61) {
-					int64_t fd   = POP_STACK();
-					Object  *ip   = POP_STACK_OBJECT();
-					int64_t port = POP_STACK();
-					char ip_c[128];
-
-					strncpy(ip_c, ip->array, ip->varlist[0].value);
-
-
-					struct sockaddr_in servaddr;
-					servaddr.sin_family = AF_INET;
-					servaddr.sin_addr.s_addr = inet_addr(ip_c);
-					servaddr.sin_port = htons((int)port);
-
-					int result = bind((int)fd, (struct sockaddr*)&servaddr, sizeof(servaddr));
-					listen((int)fd, 5);
-
-					PUSH_STACK(result == 0);
-				} 
-				else if(name == 62) {
-					int64_t fd = POP_STACK();
-
-					int newfd = accept((int)fd, NULL, 0);
-
-					PUSH_STACK(newfd);
-				} else if(name == 63) {
-					int64_t fd = POP_STACK();
-					Object *buffer = POP_STACK_OBJECT();
-					int64_t size = POP_STACK();
-
-					int r = read((int)fd, buffer->array, size);
-
-					PUSH_STACK(r);
-				} else if(name == 64) {
-					int64_t fd = POP_STACK();
-					Object *buffer = POP_STACK_OBJECT();
-					int64_t size = POP_STACK();
-
-					int w = write((int)fd, buffer->array, size);
-
-					PUSH_STACK(w);
-				} else if(name == 65) {
-					int64_t fd = POP_STACK();
-
-					close((int)fd);
-
-					PUSH_STACK(0);
-				} else if(name == 13) {
-					begin = clock();
-				} else if(name == 6969) {
-					exit(0);
-				} else if(name == 14) {
-					clock_t end = clock();
-					double time_spent = (double)(end - begin) / CLOCKS_PER_SEC;
-					printf("%f\n", time_spent);
-				} else if(name == 33) {
-					PUSH_STACK(rand());
-				} else if(name == 49935) {
-					double  number = POP_STACK_DOUBLE();
-					Object *buffer    = POP_STACK_OBJECT();
-					int length = sprintf(buffer->array, "%f", number);
-					PUSH_STACK(length);
-				} else if(name == 34569) {
-					Object *buffer = POP_STACK_OBJECT();
-					int64_t size = POP_STACK();
-
-					int r = read(STDIN_FILENO, buffer->array, size);
-
-					PUSH_STACK(r - 1);
-				} else if(name == 34555) {
-					gc(stack, 128 * 1024);
-					PUSH_STACK(0);
-				} else {
-					printf("unknown syscall %i\n", name);
-					exit(1);
-				}
+				JIT_ENTER(true);
 			}
-			break;
-			case OP_ALLOC: {
+			NEXT();
+			CASE(OP_SYSCALL) {
+				SYNC_ROOTS();
+
+				sp = runtime_syscall(stack, sp);
+			}
+			NEXT();
+			CASE(OP_ALLOC) {
+				SYNC_ROOTS();
+
 				Object *o = new_object((int)left);
 				o->type = sizeof(o);
 				PUSH_STACK_OBJECT(o);
 			}
-			break;
-			case OP_NEW_ARRAY: {
+			NEXT();
+			CASE(OP_NEW_ARRAY) {
+				SYNC_ROOTS();
+
 				int64_t count = POP_STACK();
-				int8_t  type  = (int8_t)left;
 
-				Object *instance = new_object(count * type);
-				instance->type = type;
+				Object *instance = runtime_new_array(count, (int8_t)left);
+				PUSH_STACK_OBJECT(instance);
+			}
+			NEXT();
+			CASE(OP_NEW_LOCAL_ARRAY) {
+				SYNC_ROOTS();
 
-				instance->array = malloc(sizeof(char) * (count * type));
+				int64_t count = POP_STACK();
 
-				memset(instance->array, 0, sizeof(char) * (count * type));
+				PUSH_STACK_SLOT(runtime_new_local_array(count, (int8_t)left));
+			}
+			NEXT();
+			CASE(OP_NEW_REF_ARRAY) {
+				SYNC_ROOTS();
 
-				instance->varlist[0].is_ref = false;
-				instance->varlist[0].value  = count;
+				int64_t count = POP_STACK();
 
+				Object *instance = runtime_new_array(count, (int8_t)left);
+				instance->has_refs = true;
 				PUSH_STACK_OBJECT(instance);
 			}
-			break;
-			case OP_LOAD_ARRAY: {
+			NEXT();
+			CASE(OP_LOAD_ARRAY_I8) {
 				int64_t index    = POP_STACK();
 				Object *instance = POP_STACK_OBJECT();
 
-				if(index > instance->size - 1) {
-					printf("array out of bound access read error %li %i\n", index, instance->size - 1);
-					exit(1);
-				}
+				PUSH_STACK(runtime_load_i8(instance, index));
+			}
+			NEXT();
+			CASE(OP_LOAD_ARRAY_I64) {
+				int64_t index    = POP_STACK();
+				Object *instance = POP_STACK_OBJECT();
 
-				int64_t item = 0;
-				memcpy(&item, instance->array + index, instance->type);
-				PUSH_STACK(item);
+				PUSH_STACK_SLOT(runtime_load_i64(instance, index));
 			}
-			break;
-			case OP_STORE_ARRAY: {
+			NEXT();
+			CASE(OP_STORE_ARRAY_I8) {
 				int64_t index = POP_STACK();
 				Object *instance = POP_STACK_OBJECT();
 				int64_t value = POP_STACK();
 
-				if(index > instance->size - 1) {
-					printf("array out of bound access write error %li %i\n", index, instance->size - 1);
-					exit(1);
-				}
+				runtime_store_i8(instance, index, value);
+			}
+			NEXT();
+			CASE(OP_STORE_ARRAY_I64) {
+				int64_t index = POP_STACK();
+				Object *instance = POP_STACK_OBJECT();
+				int64_t value = POP_STACK();
 
-				memcpy(instance->array + index, &value, instance->type);
+				runtime_store_i64(instance, index, value);
 			}
-			break;
-			case OP_JE: {
+			NEXT();
+			CASE(OP_LOAD_ARRAY_I8_U) {
+				int64_t index    = POP_STACK();
+				Object *instance = POP_STACK_OBJECT();
+
+				PUSH_STACK(runtime_load_i8_unchecked(instance, index));
+			}
+			NEXT();
+			CASE(OP_LOAD_ARRAY_I64_U) {
+				int64_t index    = POP_STACK();
+				Object *instance = POP_STACK_OBJECT();
+
+				PUSH_STACK_SLOT(runtime_load_i64_unchecked(instance, index));
+			}
+			NEXT();
+			CASE(OP_STORE_ARRAY_I8_U) {
+				int64_t index = POP_STACK();
+				Object *instance = POP_STACK_OBJECT();
+				int64_t value = POP_STACK();
+
+				runtime_store_i8_unchecked(instance, index, value);
+			}
+			NEXT();
+			CASE(OP_STORE_ARRAY_I64_U) {
+				int64_t index = POP_STACK();
+				Object *instance = POP_STACK_OBJECT();
+				int64_t value = POP_STACK();
+
+				runtime_store_i64_unchecked(instance, index, value);
+			}
+			NEXT();
+			CASE(OP_JE) {
 				int64_t a = POP_STACK();
 				int64_t b = POP_STACK();
 
 				if(a == b) {
 					pc = left;
-					continue;
 				}
 			}
-			break;
-			case OP_JMP: {
-				pc = left;
-				continue;
-			}
-			break;
-			case OP_RET: {
-				Slot ret_data = POP_STACK_SLOT();
-				int64_t ret_addr = POP_STACK();
+			NEXT();
+			CASE(OP_JMP) {
+				bool backward = left < pc;
 
-				POP_FRAME();
+				pc = left;
 
-				PUSH_STACK_SLOT(ret_data);
+				if(backward) {
+					JIT_ENTER(true);
+				}
+			}
+			NEXT();
+			CASE(OP_RET) {
+				/* the return value stays on top of the oprand stack */
+				Frame *frame = &frames[--fp];
 
-				pc = ret_addr;
+				vp        = frame->vp;
+				pc        = frame->pc;
+				locals    = frame->locals;
+				local_top = frame->local_top;
 
-				continue;
+				JIT_ENTER(false);
 			}
-			break;
-			case OP_HALT: {
+			NEXT();
+			CASE(OP_HALT) {
 				int64_t ret_code = POP_STACK();
 				exit(ret_code);
 			}
-			break;
-			default: {
+			NEXT();
+			CASE(OP_MOV) {
+				SET_VAR_SLOT(ins->dest, GET_VAR_SLOT(left));
+			}
+			NEXT();
+			CASE(OP_MOVI) {
+				SET_VAR_SLOT(ins->dest, ((Slot){ .is_ref = false, .value = left }));
+			}
+			NEXT();
+
+			#define REGISTER_OP_CASE(name, operator) \
+				CASE(OP_##name##_RR) { \
+					int64_t c = GET_VAR_SLOT(ins->right).value operator GET_VAR_SLOT(left).value; \
+					SET_VAR_SLOT(ins->dest, ((Slot){ .is_ref = false, .value = c })); \
+				} \
+				NEXT(); \
+				CASE(OP_##name##_RI) { \
+					int64_t c = GET_VAR_SLOT(ins->right).value operator left; \
+					SET_VAR_SLOT(ins->dest, ((Slot){ .is_ref = false, .value = c })); \
+				} \
+				NEXT();
+
+			REGISTER_OP_CASE(ADD, +)
+			REGISTER_OP_CASE(SUB, -)
+			REGISTER_OP_CASE(MUL, *)
+			REGISTER_OP_CASE(DIV, /)
+			REGISTER_OP_CASE(MOD, %)
+			REGISTER_OP_CASE(AND, &)
+			REGISTER_OP_CASE(OR, |)
+			REGISTER_OP_CASE(XOR, ^)
+			REGISTER_OP_CASE(SHL, <<)
+			REGISTER_OP_CASE(SHR, >>)
+			REGISTER_OP_CASE(CMPEQ, ==)
+			REGISTER_OP_CASE(CMPGT, >)
+			REGISTER_OP_CASE(CMPLT, <)
+
+			#undef REGISTER_OP_CASE
+
+			CASE(OP_INC_LOCAL) {
+				/* the slot may still be flagged from an object an earlier scope kept there */
+				GET_VAR_SLOT(ins->right).value += left;
+				GET_VAR_SLOT(ins->right).is_ref = false;
+			}
+			NEXT();
+			CASE(OP_JZ) {
+				int64_t a = POP_STACK();
+
+				if(a == 0) {
+					pc = left;
+				}
+			}
+			NEXT();
+			CASE(OP_JZ_LOCAL) {
+				if(GET_VAR_SLOT(ins->right).value == 0) {
+					pc = left;
+				}
+			}
+			NEXT();
+			CASE(OP_CMPEQ_JZ) {
+				int64_t a = POP_STACK();
+				int64_t b = POP_STACK();
+
+				if(!(b == a)) {
+					pc = left;
+				}
+			}
+			NEXT();
+			CASE(OP_CMPGT_JZ) {
+				int64_t a = POP_STACK();
+				int64_t b = POP_STACK();
+
+				if(!(b > a)) {
+					pc = left;
+				}
+			}
+			NEXT();
+			CASE(OP_CMPLT_JZ) {
+				int64_t a = POP_STACK();
+				int64_t b = POP_STACK();
+
+				if(!(b < a)) {
+					pc = left;
+				}
+			}
+			NEXT();
+
+			DEFAULT() {
 				printf("illegal instruction %i\n", op);
 				exit(1);
 			}
-			break;
+			NEXT();
 		}
 	}
 
@@ -653,9 +826,13 @@ void intepreter(const char *input) {
 	srand(time(NULL));
 	signal(SIGPIPE, SIG_IGN);
 
-	list_clear(&objects);
+#ifdef CHIP_PROFILE
+	profile_start();
+#endif
 
 	uint64_t entry = load_file(input);
 
+	runtime_constants(constant_pool, constant_count);
+
 	eval(entry);
 }
\ No newline at end of file
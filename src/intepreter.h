@@ -3,17 +3,47 @@
 
 #include "codegen.h"
 
-typedef struct _Object {
-	ListNode node;
-
-	char *array;
-	int type;
-	struct _Slot *varlist;
-	int size;
+/*
+	build with -DCHIP_SWITCH_DISPATCH to force the portable switch loop
+*/
+
+#if defined(__GNUC__) && !defined(CHIP_SWITCH_DISPATCH)
+# define CHIP_THREADED_DISPATCH
+#endif
+
+/*
+	header of an object block, the slots and the array payload follow 
+	it in the same block (see heap.c) so neither needs a pointer of its 
+	own. arrays keep only their length in a slot and size holds their 
+	length in bytes. has_refs arrays hold object pointers the collector 
+	follows. a free block links to the next one and a moved object to 
+	its copy through the first word after the header, every block has 
+	room for it
+*/
 
+typedef struct _Object {
+	uint32_t block;
+	int32_t size;
+	uint8_t type;
+	bool is_array;
 	bool is_marked;
+	bool is_free;
+	bool has_refs;
+	bool is_moved;
 } Object;
 
+#define OBJECT_VARLIST(o) ((struct _Slot*)((o) + 1))
+#define OBJECT_ARRAY(o) ((char*)(OBJECT_VARLIST(o) + 1))
+#define OBJECT_LINK(o) (*(Object**)((o) + 1))
+#define OBJECT_SLOTS(o) ((o)->is_array ? 1 : (o)->size)
+
+typedef struct {
+	uint8_t  op;
+	uint16_t dest;
+	int32_t  right;
+	int64_t  left;
+} Instruction;
+
 typedef struct _Slot {
 	bool is_ref;
 	union {
@@ -23,36 +53,65 @@ typedef struct _Slot {
 	};
 } Slot;
 
-#define GET_CONST(i) (constants[(int)i])
-#define SET_CONST(i, v) (constants[(int)i] = v)
-
 #define SET_VAR_SLOT(k, v) (stack[vp + k] = v)
 #define GET_VAR_SLOT(k) (stack[vp + k])
 
 #define TOP_STACK_SLOT() (stack[sp-1])
 
+/*
+	frames are exactly as large as the frame size their calls carry 
+	and follow each other from slot 0 up to STACK_BASE, the oprand 
+	stack runs from there to STACK_MAX. the stack is mapped (see 
+	runtime_stack()) so only the pages calls actually reach are backed
+*/
+
+#define STACK_BASE (1024 * 1024)
+#define STACK_MAX (STACK_BASE + 64 * 1024)
+#define STACK_SIZE (STACK_MAX + 1)
+
+/* what a call saves to return to its caller */
+typedef struct {
+	int64_t  vp;
+	uint32_t pc;
+	int      locals;
+	char    *local_top;
+} Frame;
+
+/*
+	the verifier bounds the stack of every method and OP_CALL checks 
+	it once per frame, build with -DCHIP_DEBUG to check every push/pop
+*/
+
+#ifdef CHIP_DEBUG
 #define CHECK_STACK() ({ \
 	if(sp < 0) {\
 		printf("stackunderflow, sp = %li\n", sp); \
 		exit(1); \
 	} \
-	if(sp > 65535 + 1024) {\
+	if(sp > STACK_MAX) {\
 		printf("stackoverflow, sp = %li\n", sp); \
 		exit(1); \
 	} \
 })
+#else
+#define CHECK_STACK() ((void)0)
+#endif
 
 #define DEC_STACK() (sp--, CHECK_STACK())
 #define INC_STACK() (sp++, CHECK_STACK())
 
+/*
+	a push of a number clears is_ref, a collection may start at any
+	allocation and must not take a stale one for an object. the jit
+	templates (see jit_clear_ref()) keep the same rule
+*/
+
 #define POP_STACK() (DEC_STACK(), stack[sp].value)
-#define PUSH_STACK(v) (stack[sp].value = v, INC_STACK())
+#define PUSH_STACK(v) (stack[sp].value = v, stack[sp].is_ref = false, INC_STACK())
 
 #define POP_STACK_DOUBLE() (DEC_STACK(), stack[sp].value_float)
-#define PUSH_STACK_DOUBLE(v) (stack[sp].value_float = v, INC_STACK())
+#define PUSH_STACK_DOUBLE(v) (stack[sp].value_float = v, stack[sp].is_ref = false, INC_STACK())
 
-#define POP_FRAME() (vp-=512)
-#define PUSH_FRAME() (vp+=512)
 
 #define POP_STACK_OBJECT() (DEC_STACK(), stack[sp].is_ref = false, stack[sp].ref)
 #define PUSH_STACK_OBJECT(v) (stack[sp].ref = v, stack[sp].is_ref = true, INC_STACK())
@@ -62,10 +121,8 @@ typedef struct _Slot {
 
 
 int               load_file(const char *name);
-Object           *new_object(int size);
-void              gc(Slot *stack, int size);
-void              mark(Slot *stack, int size);
-void              sweep();
+bool              op_is_jump(uint8_t op);
+int               predecode(char *bytes, int byte_size, int entry);
 int64_t           eval(int pc);
 void              intepreter(const char *input);
 
@@ -0,0 +1,687 @@
+#define _DEFAULT_SOURCE /* MAP_ANONYMOUS */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <sys/mman.h>
+#include "jit.h"
+#include "runtime.h"
+
+/*
+	Chip x86-64 template jit
+
+	a method that gets hot is translated op by op into machine code
+	templates. compiled code works on the intepreter stack in place:
+	r12 points at the frame slots, r13 at the next free oprand slot and
+	rbx at where r13 is written back. ops without a template (calls,
+	returns, syscalls, allocation, floats) leave the native code
+	with the pc to continue at, and the intepreter enters it again on
+	the next call, return or backward jump into compiled code
+*/
+
+#ifdef CHIP_JIT
+
+enum {
+	RAX = 0,
+	RCX = 1,
+	RDX = 2,
+	RBX = 3,
+	R12 = 12,
+	R13 = 13
+};
+
+#define SLOT(k) ((int32_t)(k) * (int32_t)sizeof(Slot))
+#define VALUE(k) (SLOT(k) + (int32_t)offsetof(Slot, value))
+#define TOP(k) SLOT(-(k))
+#define TOP_VALUE(k) VALUE(-(k))
+
+/* the elements of an array follow its header and length slot */
+#define ARRAY_DATA ((int32_t)(sizeof(Object) + sizeof(Slot)))
+
+void **jit_native = NULL;
+
+static Instruction *jit_codes;
+static int          jit_code_size;
+static Method      *jit_methods;
+static int          jit_method_count;
+
+static int  *order;
+static int  *hotness;
+static bool *compiled;
+
+static uint8_t *arena;
+static int      arena_used;
+static int      epilogue;
+
+/* the base stack op of each register op, mov and movi have none */
+#undef DEFINE_REGISTER_OP
+#define DEFINE_OP(name, display, oprands, pops, pushes)
+#define DEFINE_REGISTER_OP(name, display) OP_##name, OP_##name,
+static uint8_t register_base_op[] = {
+	LIST_OF_REGISTER_OPS
+};
+#undef DEFINE_OP
+#undef DEFINE_REGISTER_OP
+
+static void jit_byte(Jit *j, uint8_t byte) {
+	j->code[j->length++] = byte;
+}
+
+static void jit_emit(Jit *j, const char *bytes, int count) {
+	memcpy(j->code + j->length, bytes, count);
+	j->length += count;
+}
+
+static void jit_int32(Jit *j, int32_t value) {
+	memcpy(j->code + j->length, &value, sizeof(value));
+	j->length += sizeof(value);
+}
+
+static void jit_int64(Jit *j, int64_t value) {
+	memcpy(j->code + j->length, &value, sizeof(value));
+	j->length += sizeof(value);
+}
+
+/*
+	op reg, [base + disp32], prefix goes before the rex byte
+*/
+
+static void jit_mem(Jit *j, uint8_t prefix, bool wide, const char *opcode, int opcode_length, int reg, int base, int32_t disp) {
+	if(prefix) {
+		jit_byte(j, prefix);
+	}
+
+	uint8_t rex = 0x40 | (wide << 3) | ((reg >> 3) << 2) | (base >> 3);
+	if(rex != 0x40) {
+		jit_byte(j, rex);
+	}
+
+	jit_emit(j, opcode, opcode_length);
+	jit_byte(j, 0x80 | ((reg & 7) << 3) | (base & 7));
+
+	/* rsp and r12 as a base need a sib byte */
+	if((base & 7) == 4) {
+		jit_byte(j, 0x24);
+	}
+
+	jit_int32(j, disp);
+}
+
+static void jit_load(Jit *j, int reg, int base, int32_t disp) {
+	jit_mem(j, 0, true, "\x8b", 1, reg, base, disp);
+}
+
+static void jit_store(Jit *j, int base, int32_t disp, int reg) {
+	jit_mem(j, 0, true, "\x89", 1, reg, base, disp);
+}
+
+/*
+	whole slot through rcx and rdx, a single 16 byte load would stall 
+	on the 8 byte store an earlier op left in the slot
+*/
+
+static void jit_copy(Jit *j, int to, int32_t to_disp, int from, int32_t from_disp) {
+	jit_load(j, RCX, from, from_disp);
+	jit_load(j, RDX, from, from_disp + 8);
+	jit_store(j, to, to_disp, RCX);
+	jit_store(j, to, to_disp + 8, RDX);
+}
+
+/*
+	every slot an op pushes a value to, overwrites with one or pops is 
+	cleared like the intepreter does, a stale is_ref would have the 
+	collector take a number for an object. a mov leaves the flags alone
+*/
+
+static void jit_clear_ref(Jit *j, int base, int32_t disp) {
+	jit_mem(j, 0, false, "\xc6", 1, 0, base, disp + (int32_t)offsetof(Slot, is_ref));
+	jit_byte(j, 0);
+}
+
+/* lea keeps the flags of a compare for the branch after it */
+static void jit_stack(Jit *j, int slots) {
+	jit_mem(j, 0, true, "\x8d", 1, R13, R13, SLOT(slots));
+}
+
+static void jit_immediate(Jit *j, int reg, int64_t value) {
+	jit_byte(j, 0x48);
+	jit_byte(j, 0xb8 + reg);
+	jit_int64(j, value);
+}
+
+static void jit_exit(Jit *j, int pc) {
+	jit_byte(j, 0xb8);
+	jit_int32(j, pc);
+	jit_byte(j, 0xe9);
+	jit_int32(j, epilogue - (j->length + 4));
+}
+
+/*
+	jump or jcc to an instruction, patched once the method is laid out
+*/
+
+static void jit_branch(Jit *j, uint8_t condition, int target, JitFixup *fixups, int *fixup_count) {
+	if(condition) {
+		jit_byte(j, 0x0f);
+		jit_byte(j, condition);
+	} else {
+		jit_byte(j, 0xe9);
+	}
+
+	fixups[*fixup_count].at = j->length;
+	fixups[*fixup_count].target = target;
+	(*fixup_count)++;
+
+	jit_int32(j, 0);
+}
+
+/*
+	rax = rax <op> rcx
+*/
+
+static bool jit_alu(Jit *j, uint8_t op) {
+	switch(op) {
+		case OP_ADD: {
+			jit_emit(j, "\x48\x01\xc8", 3);
+		}
+		break;
+		case OP_SUB: {
+			jit_emit(j, "\x48\x29\xc8", 3);
+		}
+		break;
+		case OP_AND: {
+			jit_emit(j, "\x48\x21\xc8", 3);
+		}
+		break;
+		case OP_OR: {
+			jit_emit(j, "\x48\x09\xc8", 3);
+		}
+		break;
+		case OP_XOR: {
+			jit_emit(j, "\x48\x31\xc8", 3);
+		}
+		break;
+		case OP_MUL: {
+			jit_emit(j, "\x48\x0f\xaf\xc1", 4);
+		}
+		break;
+		case OP_DIV: {
+			jit_emit(j, "\x48\x99\x48\xf7\xf9", 5);
+		}
+		break;
+		case OP_MOD: {
+			jit_emit(j, "\x48\x99\x48\xf7\xf9\x48\x89\xd0", 8);
+		}
+		break;
+		case OP_SHL: {
+			jit_emit(j, "\x48\xd3\xe0", 3);
+		}
+		break;
+		case OP_SHR: {
+			jit_emit(j, "\x48\xd3\xf8", 3);
+		}
+		break;
+		case OP_CMPEQ: {
+			jit_emit(j, "\x48\x39\xc8\x0f\x94\xc0\x0f\xb6\xc0", 9);
+		}
+		break;
+		case OP_CMPGT: {
+			jit_emit(j, "\x48\x39\xc8\x0f\x9f\xc0\x0f\xb6\xc0", 9);
+		}
+		break;
+		case OP_CMPLT: {
+			jit_emit(j, "\x48\x39\xc8\x0f\x9c\xc0\x0f\xb6\xc0", 9);
+		}
+		break;
+		default: {
+			return false;
+		}
+		break;
+	}
+	return true;
+}
+
+/*
+	rax = the array at TOP_VALUE(2) plus the index at TOP_VALUE(1) 
+	scaled by width. an index out of bounds and an array of references 
+	leave for the intepreter, it reports the one and needs the barrier 
+	of the other. unchecked ops were proven in bounds
+*/
+
+static void jit_array_element(Jit *j, int width, bool checked, int pc) {
+	jit_load(j, RAX, R13, TOP_VALUE(2));
+	jit_load(j, RCX, R13, TOP_VALUE(1));
+
+	if(checked) {
+		jit_mem(j, 0, true, "\x63", 1, RDX, RAX, (int32_t)offsetof(Object, size)); // movsxd rdx, size
+		if(width == 8) {
+			jit_emit(j, "\x48\xc1\xea\x03", 4);   // shr rdx, 3
+		}
+		jit_emit(j, "\x48\x39\xd1", 3);           // cmp rcx, rdx
+		jit_byte(j, 0x72);                          // jb over the exit
+		jit_byte(j, JIT_EXIT_SIZE);
+		jit_exit(j, pc);
+	}
+
+	if(width == 8) {
+		jit_mem(j, 0, false, "\x80", 1, 7, RAX, (int32_t)offsetof(Object, has_refs));
+		jit_byte(j, 0);
+		jit_byte(j, 0x74);                      // je over the exit
+		jit_byte(j, JIT_EXIT_SIZE);
+		jit_exit(j, pc);
+
+		jit_emit(j, "\x48\xc1\xe1\x03", 4);   // shl rcx, 3
+	}
+	jit_emit(j, "\x48\x01\xc8", 3);           // add rax, rcx
+}
+
+/*
+	emits the template of one op, false when it has none
+*/
+
+static bool jit_template(Jit *j, Instruction *ins, JitFixup *fixups, int *fixup_count) {
+	uint8_t op   = ins->op;
+	int64_t left = ins->left;
+
+	if(op >= OP_LOAD_0 && op <= OP_LOAD_5) {
+		op   = OP_LOAD;
+		left = ins->op - OP_LOAD_0;
+	} else if(op >= OP_STORE_0 && op <= OP_STORE_5) {
+		op   = OP_STORE;
+		left = ins->op - OP_STORE_0;
+	} else if(op >= OP_PUSH_0 && op <= OP_PUSH_5) {
+		op   = OP_PUSH;
+		left = ins->op - OP_PUSH_0;
+	}
+
+	if(op >= OP_ADD_RR && op <= OP_CMPLT_RI) {
+		bool immediate = (op - OP_ADD_RR) % 2 == 1;
+
+		jit_load(j, RAX, R12, VALUE(ins->right));
+		if(immediate) {
+			jit_immediate(j, RCX, left);
+		} else {
+			jit_load(j, RCX, R12, VALUE(left));
+		}
+		jit_alu(j, register_base_op[op - OP_ADD_RR]);
+		jit_store(j, R12, VALUE(ins->dest), RAX);
+		jit_clear_ref(j, R12, SLOT(ins->dest));
+		return true;
+	}
+
+	switch(op) {
+		case OP_NOP: {
+
+		}
+		break;
+		case OP_LOAD: {
+			jit_copy(j, R13, TOP(0), R12, SLOT(left));
+			jit_stack(j, 1);
+		}
+		break;
+		case OP_STORE: {
+			jit_copy(j, R12, SLOT(left), R13, TOP(1));
+			jit_clear_ref(j, R13, TOP(1));
+			jit_stack(j, -1);
+		}
+		break;
+		case OP_PUSH: {
+			jit_immediate(j, RAX, left);
+			jit_store(j, R13, TOP_VALUE(0), RAX);
+			jit_clear_ref(j, R13, TOP(0));
+			jit_stack(j, 1);
+		}
+		break;
+		case OP_LOAD_CONST_SHARED: {
+			/* the constants are in place before anything gets compiled */
+			jit_immediate(j, RAX, (int64_t)constant_objects[left]);
+			jit_store(j, R13, TOP_VALUE(0), RAX);
+			jit_clear_ref(j, R13, TOP(0));
+			jit_stack(j, 1);
+		}
+		break;
+		case OP_POP: {
+			jit_clear_ref(j, R13, TOP(1));
+			jit_stack(j, -1);
+		}
+		break;
+		case OP_DUP: {
+			jit_copy(j, R13, TOP(0), R13, TOP(1));
+			jit_stack(j, 1);
+		}
+		break;
+		case OP_ADD:
+		case OP_SUB:
+		case OP_MUL:
+		case OP_DIV:
+		case OP_MOD:
+		case OP_AND:
+		case OP_OR:
+		case OP_XOR:
+		case OP_SHL:
+		case OP_SHR:
+		case OP_CMPEQ:
+		case OP_CMPGT:
+		case OP_CMPLT: {
+			jit_load(j, RAX, R13, TOP_VALUE(2));
+			jit_load(j, RCX, R13, TOP_VALUE(1));
+			jit_alu(j, op);
+			jit_store(j, R13, TOP_VALUE(2), RAX);
+			jit_clear_ref(j, R13, TOP(1));
+			jit_clear_ref(j, R13, TOP(2));
+			jit_stack(j, -1);
+		}
+		break;
+		case OP_NEG: {
+			jit_mem(j, 0, true, "\xf7", 1, 3, R13, TOP_VALUE(1));
+			jit_clear_ref(j, R13, TOP(1));
+		}
+		break;
+		case OP_NOT: {
+			jit_mem(j, 0, true, "\xf7", 1, 2, R13, TOP_VALUE(1));
+			jit_clear_ref(j, R13, TOP(1));
+		}
+		break;
+		case OP_LOAD_FIELD: {
+			/* the slots follow the header */
+			jit_load(j, RAX, R13, TOP_VALUE(1));
+			jit_copy(j, R13, TOP(1), RAX, (int32_t)sizeof(Object) + SLOT(left));
+		}
+		break;
+		case OP_STORE_FIELD: {
+			/* while the collector marks the store needs its barrier, the intepreter does it */
+			jit_immediate(j, RAX, (int64_t)&gc_phase);
+			jit_emit(j, "\x83\x38", 2);                 // cmp dword [rax], GC_MARKING
+			jit_byte(j, GC_MARKING);
+			jit_byte(j, 0x75);                          // jne over the exit
+			jit_byte(j, JIT_EXIT_SIZE);
+			jit_exit(j, (int)(ins - jit_codes));
+
+			jit_load(j, RAX, R13, TOP_VALUE(1));
+			jit_copy(j, RAX, (int32_t)sizeof(Object) + SLOT(left), R13, TOP(2));
+			jit_clear_ref(j, R13, TOP(1));
+			jit_clear_ref(j, R13, TOP(2));
+			jit_stack(j, -2);
+		}
+		break;
+		case OP_LOAD_ARRAY_I8:
+		case OP_LOAD_ARRAY_I64:
+		case OP_LOAD_ARRAY_I8_U:
+		case OP_LOAD_ARRAY_I64_U: {
+			bool checked = op == OP_LOAD_ARRAY_I8 || op == OP_LOAD_ARRAY_I64;
+
+			if(op == OP_LOAD_ARRAY_I8 || op == OP_LOAD_ARRAY_I8_U) {
+				jit_array_element(j, 1, checked, (int)(ins - jit_codes));
+				jit_mem(j, 0, false, "\x0f\xb6", 2, RCX, RAX, ARRAY_DATA); // movzx ecx, byte
+			} else {
+				jit_array_element(j, 8, checked, (int)(ins - jit_codes));
+				jit_load(j, RCX, RAX, ARRAY_DATA);
+			}
+			jit_store(j, R13, TOP_VALUE(2), RCX);
+			jit_clear_ref(j, R13, TOP(2));
+			jit_stack(j, -1);
+		}
+		break;
+		case OP_STORE_ARRAY_I8:
+		case OP_STORE_ARRAY_I64:
+		case OP_STORE_ARRAY_I8_U:
+		case OP_STORE_ARRAY_I64_U: {
+			bool checked = op == OP_STORE_ARRAY_I8 || op == OP_STORE_ARRAY_I64;
+			bool byte    = op == OP_STORE_ARRAY_I8 || op == OP_STORE_ARRAY_I8_U;
+
+			jit_array_element(j, byte ? 1 : 8, checked, (int)(ins - jit_codes));
+			jit_load(j, RDX, R13, TOP_VALUE(3));
+			if(byte) {
+				jit_mem(j, 0, false, "\x88", 1, RDX, RAX, ARRAY_DATA); // mov byte, dl
+			} else {
+				jit_store(j, RAX, ARRAY_DATA, RDX);
+			}
+			jit_clear_ref(j, R13, TOP(2));
+			jit_clear_ref(j, R13, TOP(3));
+			jit_stack(j, -3);
+		}
+		break;
+		case OP_MOV: {
+			jit_copy(j, R12, SLOT(ins->dest), R12, SLOT(left));
+		}
+		break;
+		case OP_MOVI: {
+			jit_immediate(j, RAX, left);
+			jit_store(j, R12, VALUE(ins->dest), RAX);
+			jit_clear_ref(j, R12, SLOT(ins->dest));
+		}
+		break;
+		case OP_INC_LOCAL: {
+			jit_immediate(j, RAX, left);
+			jit_mem(j, 0, true, "\x01", 1, RAX, R12, VALUE(ins->right));
+			jit_clear_ref(j, R12, SLOT(ins->right));
+		}
+		break;
+		case OP_JMP: {
+			jit_branch(j, 0, left, fixups, fixup_count);
+		}
+		break;
+		case OP_JE: {
+			jit_load(j, RAX, R13, TOP_VALUE(1));
+			jit_mem(j, 0, true, "\x3b", 1, RAX, R13, TOP_VALUE(2));
+			jit_clear_ref(j, R13, TOP(1));
+			jit_clear_ref(j, R13, TOP(2));
+			jit_stack(j, -2);
+			jit_branch(j, 0x84, left, fixups, fixup_count);
+		}
+		break;
+		case OP_JZ: {
+			jit_stack(j, -1);
+			jit_mem(j, 0, true, "\x83", 1, 7, R13, TOP_VALUE(0));
+			jit_byte(j, 0);
+			jit_clear_ref(j, R13, TOP(0));
+			jit_branch(j, 0x84, left, fixups, fixup_count);
+		}
+		break;
+		case OP_JZ_LOCAL: {
+			jit_mem(j, 0, true, "\x83", 1, 7, R12, VALUE(ins->right));
+			jit_byte(j, 0);
+			jit_branch(j, 0x84, left, fixups, fixup_count);
+		}
+		break;
+		case OP_CMPEQ_JZ:
+		case OP_CMPGT_JZ:
+		case OP_CMPLT_JZ: {
+			/* jne, jle, jge: taken when the comparison is false */
+			uint8_t condition = op == OP_CMPEQ_JZ ? 0x85 : op == OP_CMPGT_JZ ? 0x8e : 0x8d;
+
+			jit_load(j, RAX, R13, TOP_VALUE(2));
+			jit_mem(j, 0, true, "\x3b", 1, RAX, R13, TOP_VALUE(1));
+			jit_clear_ref(j, R13, TOP(1));
+			jit_clear_ref(j, R13, TOP(2));
+			jit_stack(j, -2);
+			jit_branch(j, condition, left, fixups, fixup_count);
+		}
+		break;
+		default: {
+			return false;
+		}
+		break;
+	}
+
+	return true;
+}
+
+/*
+	the shared entry and exit every compiled method jumps through
+
+	entry(locals, &top, target): saves rbx, r12, r13 and jumps to target
+	exit: eax holds the pc to continue at, writes r13 back to top
+*/
+
+static void jit_init_arena() {
+	Jit j = {
+		.code   = arena,
+		.length = 0
+	};
+
+	jit_emit(&j, "\x53\x41\x54\x41\x55", 5);   // push rbx, r12, r13
+	jit_emit(&j, "\x49\x89\xfc", 3);           // mov r12, rdi
+	jit_emit(&j, "\x48\x89\xf3", 3);           // mov rbx, rsi
+	jit_emit(&j, "\x4c\x8b\x2e", 3);           // mov r13, [rsi]
+	jit_emit(&j, "\xff\xe2", 2);               // jmp rdx
+
+	epilogue = j.length;
+
+	jit_emit(&j, "\x4c\x89\x2b", 3);           // mov [rbx], r13
+	jit_emit(&j, "\x41\x5d\x41\x5c\x5b", 5);   // pop r13, r12, rbx
+	jit_emit(&j, "\xc3", 1);                   // ret
+
+	arena_used = j.length;
+}
+
+static int jit_compare_entry(const void *a, const void *b) {
+	return jit_methods[*(const int*)a].entry - jit_methods[*(const int*)b].entry;
+}
+
+void jit_init(Instruction *codes, int code_size, Method *methods, int method_count) {
+	jit_codes        = codes;
+	jit_code_size    = code_size;
+	jit_methods      = methods;
+	jit_method_count = method_count;
+
+	jit_native = calloc(code_size, sizeof(void*));
+	hotness    = calloc(code_size, sizeof(int));
+	compiled   = calloc(method_count, sizeof(bool));
+	order      = malloc(sizeof(int) * method_count);
+
+	for(int m = 0; m < method_count; m++) {
+		order[m] = m;
+	}
+
+	qsort(order, method_count, sizeof(int), jit_compare_entry);
+
+	arena = mmap(NULL, JIT_ARENA_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(arena == MAP_FAILED) {
+		arena = NULL;
+		return;
+	}
+
+	jit_init_arena();
+
+	mprotect(arena, JIT_ARENA_SIZE, PROT_READ | PROT_EXEC);
+}
+
+/*
+	methods are laid out one after another, the one holding pc is the
+	last that starts at or before it
+*/
+
+static int jit_method_at(int pc, int *end) {
+	int low  = 0;
+	int high = jit_method_count - 1;
+
+	while(low < high) {
+		int middle = (low + high + 1) / 2;
+		if(jit_methods[order[middle]].entry <= pc) {
+			low = middle;
+		} else {
+			high = middle - 1;
+		}
+	}
+
+	*end = low + 1 < jit_method_count ? jit_methods[order[low + 1]].entry : jit_code_size;
+
+	return order[low];
+}
+
+/*
+	counts a method entry or loop header, true once its method is compiled
+*/
+
+bool jit_hot(int pc) {
+	if(++hotness[pc] != JIT_THRESHOLD) {
+		return false;
+	}
+
+	int end;
+	int method = jit_method_at(pc, &end);
+
+	if(compiled[method]) {
+		return false;
+	}
+
+	return jit_compile(method) && jit_native[pc] != NULL;
+}
+
+bool jit_compile(int method) {
+	int end;
+	int start = jit_methods[method].entry;
+
+	jit_method_at(start, &end);
+
+	int count = end - start;
+	int limit = count * (JIT_MAX_TEMPLATE + JIT_EXIT_SIZE) + JIT_EXIT_SIZE;
+
+	compiled[method] = true;
+
+	if(!arena || arena_used + limit > JIT_ARENA_SIZE) {
+		return false;
+	}
+
+	int      *offsets = malloc(sizeof(int) * count);
+	JitFixup *fixups  = malloc(sizeof(JitFixup) * count);
+	int       fixup_count = 0;
+
+	mprotect(arena, JIT_ARENA_SIZE, PROT_READ | PROT_WRITE);
+
+	Jit j = {
+		.code   = arena,
+		.length = arena_used
+	};
+
+	for(int pc = start; pc < end; pc++) {
+		offsets[pc - start] = j.length;
+
+		if(jit_template(&j, &jit_codes[pc], fixups, &fixup_count)) {
+			jit_native[pc] = arena + offsets[pc - start];
+		} else {
+			jit_exit(&j, pc);
+		}
+	}
+
+	/* falling through the last op continues in the intepreter */
+	jit_exit(&j, end);
+
+	for(int f = 0; f < fixup_count; f++) {
+		int target = fixups[f].target;
+		int to;
+
+		if(target >= start && target < end) {
+			to = offsets[target - start];
+		} else {
+			to = j.length;
+			jit_exit(&j, target);
+		}
+
+		int32_t rel = to - (fixups[f].at + 4);
+		memcpy(arena + fixups[f].at, &rel, sizeof(rel));
+	}
+
+	arena_used = j.length;
+
+	mprotect(arena, JIT_ARENA_SIZE, PROT_READ | PROT_EXEC);
+
+	free(offsets);
+	free(fixups);
+
+	return true;
+}
+
+int jit_run(Slot *stack, int64_t vp, int64_t *sp, int pc) {
+	Slot *top = stack + *sp;
+
+	int next = ((jit_entry_t)arena)(stack + vp, &top, jit_native[pc]);
+
+	*sp = top - stack;
+
+	return next;
+}
+
+#endif
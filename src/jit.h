@@ -0,0 +1,46 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "intepreter.h"
+#include "verify.h"
+
+/*
+	the template jit is built on x86-64 linux unless -DCHIP_NO_JIT is
+	given, profiling builds leave it out so every op gets counted
+*/
+
+#if defined(__x86_64__) && defined(__linux__) && !defined(CHIP_NO_JIT) && !defined(CHIP_PROFILE)
+# define CHIP_JIT
+#endif
+
+/* method entries and loop headers reached this often get compiled */
+#define JIT_THRESHOLD 1000
+
+/* largest op template and side exit in bytes */
+#define JIT_MAX_TEMPLATE 128
+#define JIT_EXIT_SIZE 10
+
+/* code arena shared by every compiled method */
+#define JIT_ARENA_SIZE (16 * 1024 * 1024)
+
+typedef struct {
+	uint8_t *code;
+	int length;
+} Jit;
+
+typedef struct {
+	int at;
+	int target;
+} JitFixup;
+
+typedef int (*jit_entry_t)(Slot *locals, Slot **top, void *target);
+
+/* native code of every compiled instruction, NULL when it is interpreted */
+extern void     **jit_native;
+
+void              jit_init(Instruction *codes, int code_size, Method *methods, int method_count);
+bool              jit_hot(int pc);
+bool              jit_compile(int method);
+int               jit_run(Slot *stack, int64_t vp, int64_t *sp, int pc);
+
+#endif
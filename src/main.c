@@ -6,6 +6,7 @@
 #include "codegen.h"
 #include "semantic.h"
 #include "intepreter.h"
+#include "aot.h"
 
 int main(int argc, char const *argv[]) {
 	/* code */
@@ -25,11 +26,16 @@ int main(int argc, char const *argv[]) {
 			gen(nodes, "a.out");
 		} else if(strcmp(argv[1], "run") == 0) {
 			intepreter(argv[2]);
+		} else if(strcmp(argv[1], "aot") == 0) {
+			char output[strlen(argv[2]) + 3];
+			sprintf(output, "%s.c", argv[2]);
+
+			aot(argv[2], output);
 		} else {
-			printf("usage: %s compile|run <file>\n", argv[0]);
+			printf("usage: %s compile|run|aot <file>\n", argv[0]);
 		}
 	} else {
-		printf("usage: %s compile|run <file>\n", argv[0]);
+		printf("usage: %s compile|run|aot <file>\n", argv[0]);
 	}
 
 	return 0;
@@ -3,10 +3,237 @@
 #include "optimize.h"
 #include "codegen.h"
 
-void optimize(Op **codes, int code_count, Label *labels, int label_count) {
+int optimize(Op **codes, int code_count, Label *labels, int label_count) {
+	code_count = optimize_rewrite(codes, code_count, labels, label_count, optimize_match_assign);
+	code_count = optimize_rewrite(codes, code_count, labels, label_count, optimize_match_super);
+#ifdef CHIP_REGISTER_VM
+	code_count = optimize_rewrite(codes, code_count, labels, label_count, optimize_match_register);
+#endif
 	optimize_shortcut(codes, code_count, labels, label_count);
 	//optimize_deadcode(codes, code_count);
 	optimize_graph(codes, code_count, labels, label_count);
+
+	return code_count;
+}
+
+/*
+	runs match at every op and replaces the window it consumed with the 
+	op it returns (or nothing). windows never swallow a label, so jumps 
+	stay valid once the label lines are remapped. returns the new count
+*/
+
+int optimize_rewrite(Op **codes, int code_count, Label *labels, int label_count, optimize_match_t match) {
+	bool *target = calloc(code_count + 1, sizeof(bool));
+	int  *map    = malloc(sizeof(int) * (code_count + 1));
+
+	for(int j = 0; j < label_count; ++j) {
+		target[labels[j].line] = true;
+	}
+
+	int count = 0;
+	int i = 0;
+	while(i < code_count) {
+		int available = 1;
+		while(i + available < code_count && !target[i + available] && available < 8) {
+			available++;
+		}
+
+		Op *result = NULL;
+		int length = match(codes + i, available, &result);
+
+		map[i] = count;
+
+		if(length > 0) {
+			if(result) {
+				codes[count++] = result;
+			}
+			i += length;
+		} else {
+			codes[count++] = codes[i++];
+		}
+	}
+	map[code_count] = count;
+
+	for(int j = 0; j < label_count; ++j) {
+		labels[j].line = map[labels[j].line];
+	}
+
+	free(target);
+	free(map);
+
+	return count;
+}
+
+/*
+	x = y; as a statement: dup, store x, pop => store x
+*/
+
+int optimize_match_assign(Op **codes, int available, Op **result) {
+	if(available >= 3 && codes[0]->op == OP_DUP && codes[1]->op == OP_STORE && codes[2]->op == OP_POP) {
+		*result = codes[1];
+		return 3;
+	}
+	return 0;
+}
+
+/*
+	the fused compare and branch of a compare op
+*/
+
+static int optimize_compare_jz(OpType op) {
+	switch(op) {
+		case OP_CMPEQ: {
+			return OP_CMPEQ_JZ;
+		}
+		break;
+		case OP_CMPGT: {
+			return OP_CMPGT_JZ;
+		}
+		break;
+		case OP_CMPLT: {
+			return OP_CMPLT_JZ;
+		}
+		break;
+	}
+	return -1;
+}
+
+/*
+	fuses the loop increments and loop conditions gen_while and gen_for 
+	leave behind into superinstructions, longest sequence first
+*/
+
+int optimize_match_super(Op **codes, int available, Op **result) {
+	if(available >= 4 && codes[0]->op == OP_LOAD && codes[1]->op == OP_PUSH && codes[3]->op == OP_STORE && codes[0]->left == codes[3]->left) {
+		if(codes[2]->op == OP_ADD) {
+			*result = new_op(OP_INC_LOCAL, codes[1]->left, codes[0]->left, 0);
+			return 4;
+		}
+		if(codes[2]->op == OP_SUB) {
+			*result = new_op(OP_INC_LOCAL, -codes[1]->left, codes[0]->left, 0);
+			return 4;
+		}
+	}
+
+	if(available >= 3 && codes[1]->op == OP_PUSH && codes[1]->left == 0 && codes[2]->op == OP_JE) {
+		if(codes[0]->op == OP_LOAD) {
+			*result = new_op(OP_JZ_LOCAL, 0, codes[0]->left, 0);
+			(*result)->label = codes[2]->label;
+			return 3;
+		}
+
+		int op = optimize_compare_jz(codes[0]->op);
+		if(op != -1) {
+			*result = new_op(op, 0, 0, 0);
+			(*result)->label = codes[2]->label;
+			return 3;
+		}
+	}
+
+	if(available >= 2 && codes[0]->op == OP_PUSH && codes[0]->left == 0 && codes[1]->op == OP_JE) {
+		*result = new_op(OP_JZ, 0, 0, 0);
+		(*result)->label = codes[1]->label;
+		return 2;
+	}
+
+	return 0;
+}
+
+/*
+	the register form of a stack op, the .ri form follows right after it
+*/
+
+static int optimize_register_op(OpType op) {
+	switch(op) {
+		case OP_ADD: {
+			return OP_ADD_RR;
+		}
+		break;
+		case OP_SUB: {
+			return OP_SUB_RR;
+		}
+		break;
+		case OP_MUL: {
+			return OP_MUL_RR;
+		}
+		break;
+		case OP_DIV: {
+			return OP_DIV_RR;
+		}
+		break;
+		case OP_MOD: {
+			return OP_MOD_RR;
+		}
+		break;
+		case OP_AND: {
+			return OP_AND_RR;
+		}
+		break;
+		case OP_OR: {
+			return OP_OR_RR;
+		}
+		break;
+		case OP_XOR: {
+			return OP_XOR_RR;
+		}
+		break;
+		case OP_SHL: {
+			return OP_SHL_RR;
+		}
+		break;
+		case OP_SHR: {
+			return OP_SHR_RR;
+		}
+		break;
+		case OP_CMPEQ: {
+			return OP_CMPEQ_RR;
+		}
+		break;
+		case OP_CMPGT: {
+			return OP_CMPGT_RR;
+		}
+		break;
+		case OP_CMPLT: {
+			return OP_CMPLT_RR;
+		}
+		break;
+	}
+	return -1;
+}
+
+/*
+	turns stack sequences that only move values between locals into 
+	register ops addressing the frame slots directly
+
+	load a, load b, <op>, store c => <op>.rr c, a, b
+	load a, push k, <op>, store c => <op>.ri c, a, k
+	load a, store c               => mov c, a
+	push k, store c               => movi c, k
+*/
+
+int optimize_match_register(Op **codes, int available, Op **result) {
+	if(available >= 4 && codes[0]->op == OP_LOAD && (codes[1]->op == OP_LOAD || codes[1]->op == OP_PUSH) && codes[3]->op == OP_STORE) {
+		int op = optimize_register_op(codes[2]->op);
+		if(op != -1) {
+			if(codes[1]->op == OP_PUSH) {
+				op++; // .ri
+			}
+			*result = new_op(op, codes[1]->left, codes[0]->left, codes[3]->left);
+			return 4;
+		}
+	}
+
+	if(available >= 2 && codes[0]->op == OP_LOAD && codes[1]->op == OP_STORE) {
+		*result = new_op(OP_MOV, codes[0]->left, 0, codes[1]->left);
+		return 2;
+	}
+
+	if(available >= 2 && codes[0]->op == OP_PUSH && codes[1]->op == OP_STORE) {
+		*result = new_op(OP_MOVI, codes[0]->left, 0, codes[1]->left);
+		return 2;
+	}
+
+	return 0;
 }
 
 void optimize_shortcut(Op **codes, int code_count, Label *labels, int label_count) {
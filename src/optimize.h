@@ -11,7 +11,13 @@ typedef struct {
 	int code_count;
 } graph_t;
 
-void            optimize(Op **codes, int code_count, Label *labels, int label_count);
+typedef int (*optimize_match_t)(Op **codes, int available, Op **result);
+
+int             optimize(Op **codes, int code_count, Label *labels, int label_count);
+int             optimize_rewrite(Op **codes, int code_count, Label *labels, int label_count, optimize_match_t match);
+int             optimize_match_assign(Op **codes, int available, Op **result);
+int             optimize_match_super(Op **codes, int available, Op **result);
+int             optimize_match_register(Op **codes, int available, Op **result);
 void            optimize_shortcut(Op **codes, int code_count, Label *labels, int label_count);
 void            optimize_deadcode(Op **codes, int code_count, Label *labels, int label_count);
 void            optimize_graph(Op **codes, int code_count, Label *labels, int label_count);
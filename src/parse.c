@@ -28,6 +28,12 @@ Node *new_node(NodeType type, Token *token) {
 
 	node->offset = 0;
 
+	node->in_bounds = false;
+
+	node->in_frame = false;
+
+	node->shared = false;
+
 	list_clear(&node->bodylist);
 
 	return node;
@@ -155,6 +161,10 @@ static Node *parse_program(Token **current) {
 	return node;
 }
 
+/* every module is read and parsed once, importing it again adds nothing */
+static char *modules[256] = {};
+static int   module_count = 0;
+
 static Node *parse_import(Token **current) {
 	Node *node = new_node(ND_IMPORT, NULL);
 
@@ -163,6 +173,19 @@ static Node *parse_import(Token **current) {
 	expect_type(current, TK_IDENTIFIER);
 	expect_string(current, ";");
 
+	for(int i = 0; i < module_count; i++) {
+		if(strcmp(modules[i], module) == 0) {
+			node->body = new_node(ND_PROGRAM, NULL);
+			return node;
+		}
+	}
+
+	if(module_count == sizeof(modules) / sizeof(modules[0])) {
+		printf("error: too many imports\n");
+		exit(1);
+	}
+	modules[module_count++] = module;
+
 	char filename[1024];
 	sprintf(filename, "libchip/%s.chip", module);
 
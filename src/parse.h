@@ -88,6 +88,12 @@ typedef struct _Node {
 	TyMethod *method;
 
 	int offset;
+
+	bool in_bounds; // array access proven in bounds (see bounds.c)
+
+	bool in_frame; // allocation that never outlives its method (see escape.c)
+
+	bool shared; // string constant that is only ever read (see escape.c)
 } Node;
 
 Node              *new_node(NodeType type, Token *token);
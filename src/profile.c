@@ -0,0 +1,93 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include "profile.h"
+#include "codegen.h"
+
+/*
+	Chip op sequence profiler
+
+	keeps the last few executed ops in a shift register and counts
+	every sequence of 1 to PROFILE_MAX_GRAM ops ending at the current
+	one. sequences are dynamic, they can run across a taken jump
+*/
+
+#define PROFILE_TABLE_SIZE (1 << 16)
+
+static ProfileGram table[PROFILE_TABLE_SIZE];
+static uint32_t history = 0;
+static int seen = 0;
+static uint64_t total = 0;
+
+void profile_start() {
+	atexit(profile_dump);
+}
+
+static void profile_count(uint64_t key) {
+	uint64_t hash = (key * 0x9E3779B97F4A7C15ull) >> 48;
+
+	for(int probe = 0; probe < PROFILE_TABLE_SIZE; probe++) {
+		ProfileGram *gram = &table[(hash + probe) & (PROFILE_TABLE_SIZE - 1)];
+
+		if(gram->key == key) {
+			gram->count++;
+			return;
+		}
+
+		if(gram->key == 0) {
+			gram->key = key;
+			gram->count = 1;
+			return;
+		}
+	}
+}
+
+void profile_op(uint8_t op) {
+	history = (history << 8) | op;
+	if(seen < PROFILE_MAX_GRAM) {
+		seen++;
+	}
+	total++;
+
+	for(int n = 1; n <= seen; n++) {
+		uint32_t ops = n == 4 ? history : history & ((1u << (8 * n)) - 1);
+		profile_count(((uint64_t)n << 32) | ops);
+	}
+}
+
+static int profile_compare(const void *a, const void *b) {
+	const ProfileGram *x = a;
+	const ProfileGram *y = b;
+
+	if(x->count == y->count) {
+		return 0;
+	}
+	return x->count < y->count ? 1 : -1;
+}
+
+void profile_dump() {
+	ProfileGram *grams = malloc(sizeof(ProfileGram) * PROFILE_TABLE_SIZE);
+
+	for(int n = 1; n <= PROFILE_MAX_GRAM; n++) {
+		int count = 0;
+		for(int i = 0; i < PROFILE_TABLE_SIZE; i++) {
+			if(table[i].key >> 32 == n) {
+				grams[count++] = table[i];
+			}
+		}
+
+		qsort(grams, count, sizeof(ProfileGram), profile_compare);
+
+		fprintf(stderr, "%i-grams of %lu ops\n", n, total);
+
+		for(int i = 0; i < count && i < PROFILE_TOP; i++) {
+			fprintf(stderr, "%12lu %6.2f%%\t", grams[i].count, 100.0 * grams[i].count / total);
+
+			for(int o = n - 1; o >= 0; o--) {
+				uint8_t op = (grams[i].key >> (8 * o)) & 0xFF;
+				fprintf(stderr, "%s%s", op_display[op], o ? ", " : "\n");
+			}
+		}
+	}
+
+	free(grams);
+}
@@ -0,0 +1,30 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+
+/*
+	build with -DCHIP_PROFILE (make profile) to count the op sequences
+	the intepreter executes, the most frequent ones are printed to
+	stderr on exit and are the candidates for superinstructions
+*/
+
+#define PROFILE_MAX_GRAM 4
+#define PROFILE_TOP 16
+
+typedef struct {
+	uint64_t key;
+	uint64_t count;
+} ProfileGram;
+
+#ifdef CHIP_PROFILE
+# define PROFILE_OP(op) profile_op(op)
+#else
+# define PROFILE_OP(op) ((void)0)
+#endif
+
+void              profile_start();
+void              profile_op(uint8_t op);
+void              profile_dump();
+
+#endif
@@ -0,0 +1,878 @@
+/*
+	The Chip Language Runtime
+
+	objects, the collector and syscalls, shared by the intepreter and 
+	programs compiled ahead of time (see aot.c)
+*/
+
+#define _DEFAULT_SOURCE /* MAP_ANONYMOUS */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include "chip.h"
+#include "list.h"
+#include "runtime.h"
+#include "heap.h"
+
+#if defined(__GNUC__)
+# define PREFETCH(p) __builtin_prefetch(p)
+#else
+# define PREFETCH(p) ((void)0)
+#endif
+
+static clock_t begin;
+
+Roots roots;
+
+char *local_top = NULL;
+char *local_end = NULL;
+
+Object **constant_objects = NULL;
+
+static size_t  gc_allocated   = 0;
+static size_t  gc_threshold   = GC_MIN_THRESHOLD;
+static int64_t gc_collections = 0;
+static int64_t gc_pause       = GC_PAUSE;
+static int64_t gc_cap         = GC_CAP;
+static int64_t gc_step_size   = GC_STEP;
+static int64_t gc_threads     = GC_THREADS;
+static int64_t gc_compaction  = GC_COMPACT;
+
+/*
+	number of arguments each syscall takes from the stack besides its 
+	name, every syscall leaves one result. -1 for unknown syscalls
+*/
+
+int syscall_argc(int name) {
+	switch(name) {
+		case 13:
+		case 14:
+		case 33:
+		case 60:
+		case 6969:
+		case 34555: {
+			return 0;
+		}
+		break;
+		case 1:
+		case 2:
+		case 5:
+		case 62:
+		case 65:
+		case 2000:
+		case 34556: {
+			return 1;
+		}
+		break;
+		case 49935:
+		case 34569:
+		case 34557: {
+			return 2;
+		}
+		break;
+		case 61:
+		case 63:
+		case 64: {
+			return 3;
+		}
+		break;
+		case 8000: {
+			return 5;
+		}
+		break;
+	}
+	return -1;
+}
+
+int allocs = 0;
+
+/*
+	the collector is tri-color. an object is black or grey once its 
+	is_marked equals gc_marked, grey ones are on the mark stack. every 
+	cycle flips gc_marked so all survivors of the last one turn white 
+	without being touched, and objects are allocated black
+*/
+
+int gc_phase = GC_IDLE;
+
+static bool gc_marked = true;
+
+/*
+	maps the stack, the size of each frame and the frame region, a 
+	page of any is only backed once a call reaches it. objects allocated after this 
+	can start a collection, so every live reference has to be on the 
+	stack by then
+*/
+
+Slot *runtime_stack() {
+	Slot *stack  = mmap(NULL, sizeof(Slot) * STACK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	int  *locals = mmap(NULL, sizeof(int) * STACK_BASE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	char *region = mmap(NULL, LOCAL_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if(stack == MAP_FAILED || locals == MAP_FAILED || region == MAP_FAILED) {
+		printf("out of memory\n");
+		exit(1);
+	}
+
+	local_top = region;
+	local_end = region + LOCAL_SIZE;
+
+	roots.stack  = stack;
+	roots.locals = locals;
+	roots.vp     = 0;
+	roots.sp     = STACK_BASE;
+
+	return stack;
+}
+
+/*
+	fills in the header of every constant of the pool (see chip.h) and 
+	turns the offsets in front of them into the pointers to them, 
+	nothing is allocated or copied
+*/
+
+_Static_assert(sizeof(Object) + sizeof(Slot) == CONST_HEADER, "constant pool layout");
+
+void runtime_constants(char *pool, int64_t count) {
+	constant_objects = (Object**)pool;
+
+	for(int64_t c = 0; c < count; c++) {
+		Object  *o      = (Object*)(pool + NTOHLL(((uint64_t*)pool)[c]));
+		int64_t  length = NTOHLL(*(uint64_t*)(o + 1));
+
+		o->block     = CONST_HEADER + CONST_ROUND(length + 1);
+		o->size      = length + 1;
+		o->type      = sizeof(char);
+		o->is_array  = true;
+		o->is_marked = false;
+		o->is_free   = false;
+		o->has_refs  = false;
+		o->is_moved  = false;
+
+		OBJECT_VARLIST(o)[0].is_ref = false;
+		OBJECT_VARLIST(o)[0].value  = length;
+
+		constant_objects[c] = o;
+	}
+}
+
+/*
+	counts bytes about to be allocated. with a step budget a cycle 
+	started over the threshold advances by one step per allocation, 
+	without one the whole collection runs at once. a cycle still 
+	running when the step is turned off is finished right away, a step 
+	of nothing would never get it done
+*/
+
+static void gc_step(size_t bytes) {
+	gc_allocated += bytes;
+
+	if(!roots.stack) {
+		return;
+	}
+
+	if(gc_phase != GC_IDLE && gc_step_size > 0) {
+		gc_run(gc_step_size);
+	} else if(gc_phase != GC_IDLE) {
+		while(gc_phase != GC_IDLE) {
+			gc_run(INT64_MAX);
+		}
+	} else if(gc_allocated > gc_threshold && gc_pause > 0) {
+		if(gc_step_size > 0) {
+			gc_run(gc_step_size);
+		} else {
+			gc();
+		}
+	}
+}
+
+Object *new_object(int size) {
+	gc_step(sizeof(Object) + sizeof(Slot) * size);
+
+	Object *o = heap_alloc(size, 0, false);
+	o->is_marked = gc_marked;
+
+	allocs++;
+
+	return o;
+}
+
+/*
+	an array block holds the length slot with the element count that 
+	.count reads and then the count * type bytes of its elements
+*/
+
+Object *new_array(int64_t count, int type) {
+	gc_step(sizeof(Object) + sizeof(Slot) + count * type);
+
+	Object *o = heap_alloc(1, count * type, true);
+	o->size      = count * type;
+	o->type      = type;
+	o->is_marked = gc_marked;
+
+	OBJECT_VARLIST(o)[0].is_ref = false;
+	OBJECT_VARLIST(o)[0].value  = count;
+
+	allocs++;
+
+	return o;
+}
+
+static void release(Object *object) {
+	heap_free(object);
+
+	allocs--;
+}
+
+/* a cycle in progress may hold the object grey or sweep past it */
+void free_object(Object *object) {
+	if(object->is_free) {
+		return;
+	}
+
+	while(gc_phase != GC_IDLE) {
+		gc_run(INT64_MAX);
+	}
+
+	release(object);
+}
+
+/*
+	marked objects whose slots are still to be scanned. an explicit 
+	stack instead of recursion, so a long chain of objects can not 
+	overflow the c stack
+*/
+
+typedef struct {
+	Object **items;
+	int top;
+	int size;
+} MarkStack;
+
+static MarkStack marks;
+
+static void mark_stack_push(MarkStack *stack, Object *o) {
+	if(stack->top == stack->size) {
+		stack->size  = stack->size ? stack->size * 2 : 1024;
+		stack->items = realloc(stack->items, sizeof(Object*) * stack->size);
+		if(!stack->items) {
+			printf("out of memory\n");
+			exit(1);
+		}
+	}
+
+	stack->items[stack->top++] = o;
+}
+
+void gc_shade(Object *o) {
+	if(o->is_marked == gc_marked) {
+		return;
+	}
+	o->is_marked = gc_marked;
+
+	mark_stack_push(&marks, o);
+}
+
+/* parallel markers race for an object, only the one that flips its mark scans it */
+static inline void mark_child(Object *o, MarkStack *stack, bool parallel) {
+	if(parallel) {
+		if(__atomic_exchange_n(&o->is_marked, gc_marked, __ATOMIC_RELAXED) != gc_marked) {
+			mark_stack_push(stack, o);
+		}
+	} else if(o->is_marked != gc_marked) {
+		o->is_marked = gc_marked;
+		mark_stack_push(stack, o);
+	}
+}
+
+/* pops and scans one grey object, returns the slots it scanned */
+static int mark_scan(MarkStack *stack, bool parallel) {
+	Object *o = stack->items[--stack->top];
+
+	/* the next object is scanned right after this one */
+	if(stack->top > 0) {
+		PREFETCH(stack->items[stack->top - 1]);
+	}
+
+	Slot *slots = OBJECT_VARLIST(o);
+	for(int y = 0; y < OBJECT_SLOTS(o); y++) {
+		if(slots[y].is_ref) {
+			mark_child(slots[y].ref, stack, parallel);
+		}
+	}
+
+	int work = OBJECT_SLOTS(o) + 1;
+
+	if(o->has_refs) {
+		Object **elements = (Object**)OBJECT_ARRAY(o);
+		for(int y = 0; y < o->size / (int)sizeof(Object*); y++) {
+			if(elements[y]) {
+				mark_child(elements[y], stack, parallel);
+			}
+		}
+		work += o->size / (int)sizeof(Object*);
+	}
+
+	return work;
+}
+
+static void mark(Slot *stack, int size) {
+	for(int y = 0; y < size; y++) {
+		if(stack[y].is_ref) {
+			gc_shade(stack[y].ref);
+		}
+	}
+}
+
+static void mark_roots() {
+	for(int64_t vp = 0; vp <= roots.vp; vp += roots.locals[vp]) {
+		mark(roots.stack + vp, roots.locals[vp]);
+	}
+	mark(roots.stack + STACK_BASE, roots.sp - STACK_BASE);
+}
+
+/* scans grey objects for about budget slots, true once none are left */
+static bool mark_drain(int64_t budget) {
+	while(marks.top > 0 && budget > 0) {
+		budget -= mark_scan(&marks, false);
+	}
+
+	return marks.top == 0;
+}
+
+/*
+	walks the blocks of every chunk from where the last step stopped. 
+	chunks added since the cycle started come first in the list, they 
+	hold only black objects and are never reached
+*/
+
+static HeapChunk *sweep_chunk = NULL;
+static char      *sweep_block = NULL;
+
+static void sweep_start() {
+	sweep_chunk = heap_chunks;
+	sweep_block = sweep_chunk ? HEAP_CHUNK_DATA(sweep_chunk) : NULL;
+}
+
+/* sweeps about budget blocks, true once every chunk is done */
+static bool sweep(int64_t budget) {
+	while(sweep_chunk && budget-- > 0) {
+		if(sweep_block >= sweep_chunk->top) {
+			sweep_chunk = sweep_chunk->next;
+			sweep_block = sweep_chunk ? HEAP_CHUNK_DATA(sweep_chunk) : NULL;
+			continue;
+		}
+
+		Object *object = (Object*)sweep_block;
+		sweep_block += object->block;
+
+		if(object->is_free || object->is_marked == gc_marked) {
+			continue;
+		}
+
+		/* a large object takes its chunk with it, move on first */
+		if(object->block > HEAP_LARGE) {
+			sweep_chunk = sweep_chunk->next;
+			sweep_block = sweep_chunk ? HEAP_CHUNK_DATA(sweep_chunk) : NULL;
+		}
+
+		release(object);
+	}
+
+	return sweep_chunk == NULL;
+}
+
+/* the next cycle starts once pause percent of what survived is allocated */
+static void gc_end() {
+	size_t threshold = heap_in_use * gc_pause / 100;
+	if(threshold < GC_MIN_THRESHOLD) {
+		threshold = GC_MIN_THRESHOLD;
+	}
+	if(threshold > (size_t)gc_cap) {
+		threshold = gc_cap;
+	}
+
+	gc_threshold = threshold;
+	gc_allocated = 0;
+	gc_collections++;
+
+	gc_phase = GC_IDLE;
+}
+
+/*
+	one step of a cycle. a cycle shades the roots, scans grey objects 
+	while the mutator runs, shades the roots again and scans what they 
+	reach at once, then sweeps. stores into the heap in between go 
+	through runtime_barrier, stores into frames are caught by the 
+	second pass over the roots
+*/
+
+void gc_run(int64_t budget) {
+	switch(gc_phase) {
+		case GC_IDLE: {
+			gc_marked = !gc_marked;
+			gc_phase  = GC_MARKING;
+
+			mark_roots();
+		}
+		break;
+		case GC_MARKING: {
+			if(mark_drain(budget)) {
+				mark_roots();
+				mark_drain(INT64_MAX);
+
+				sweep_start();
+				gc_phase = GC_SWEEPING;
+			}
+		}
+		break;
+		case GC_SWEEPING: {
+			if(sweep(budget)) {
+				gc_end();
+			}
+		}
+		break;
+	}
+}
+
+/*
+	whole collections spread over gc_threads threads. markers scan 
+	from a stack of their own and move half of it to the shared pool 
+	while another marker is idle, a marker out of work takes a batch 
+	from the pool. the mark ends once every marker waits on an empty 
+	pool. sweepers then take every n-th chunk and the heap merges what 
+	they freed
+*/
+
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t  wake;
+	MarkStack       shared;
+	int             idle;
+	int             workers;
+} pool = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.wake = PTHREAD_COND_INITIALIZER
+};
+
+static void mark_share(MarkStack *local) {
+	pthread_mutex_lock(&pool.lock);
+
+	int half = local->top / 2;
+	for(int i = local->top - half; i < local->top; i++) {
+		mark_stack_push(&pool.shared, local->items[i]);
+	}
+	local->top -= half;
+
+	pthread_cond_broadcast(&pool.wake);
+	pthread_mutex_unlock(&pool.lock);
+}
+
+static void *mark_worker(void *arg) {
+	MarkStack local = {0};
+
+	for(;;) {
+		while(local.top > 0) {
+			mark_scan(&local, true);
+
+			if(local.top > GC_MARK_BATCH && __atomic_load_n(&pool.idle, __ATOMIC_RELAXED) > 0) {
+				mark_share(&local);
+			}
+		}
+
+		pthread_mutex_lock(&pool.lock);
+
+		__atomic_add_fetch(&pool.idle, 1, __ATOMIC_RELAXED);
+		while(pool.shared.top == 0 && pool.idle < pool.workers) {
+			pthread_cond_wait(&pool.wake, &pool.lock);
+		}
+
+		if(pool.shared.top == 0) {
+			pthread_cond_broadcast(&pool.wake);
+			pthread_mutex_unlock(&pool.lock);
+			break;
+		}
+
+		__atomic_sub_fetch(&pool.idle, 1, __ATOMIC_RELAXED);
+
+		while(pool.shared.top > 0 && local.top < GC_MARK_BATCH) {
+			mark_stack_push(&local, pool.shared.items[--pool.shared.top]);
+		}
+
+		pthread_mutex_unlock(&pool.lock);
+	}
+
+	free(local.items);
+
+	return NULL;
+}
+
+typedef struct {
+	HeapChunk **chunks;
+	int chunk_count;
+	int first;
+	int step;
+	HeapSweep sweep;
+} SweepWork;
+
+static void *sweep_worker(void *arg) {
+	SweepWork *work = arg;
+
+	for(int c = work->first; c < work->chunk_count; c += work->step) {
+		heap_sweep_chunk(work->chunks[c], gc_marked, &work->sweep);
+	}
+
+	return NULL;
+}
+
+/*
+	runs fn on threads - 1 new threads and this one, each with its own 
+	arg. a marker that could not start is dropped from the pool, the 
+	work of a sweeper that could not start is done here
+*/
+
+static void gc_spawn(void *(*fn)(void*), void *args, size_t arg_size, int threads, bool marking) {
+	pthread_t workers[GC_MAX_THREADS];
+	bool      started[GC_MAX_THREADS];
+
+	for(int t = 1; t < threads; t++) {
+		void *arg = args ? (char*)args + t * arg_size : NULL;
+
+		started[t] = pthread_create(&workers[t], NULL, fn, arg) == 0;
+
+		if(!started[t] && marking) {
+			pthread_mutex_lock(&pool.lock);
+			pool.workers--;
+			pthread_cond_broadcast(&pool.wake);
+			pthread_mutex_unlock(&pool.lock);
+		} else if(!started[t]) {
+			fn(arg);
+		}
+	}
+
+	fn(args);
+
+	for(int t = 1; t < threads; t++) {
+		if(started[t]) {
+			pthread_join(workers[t], NULL);
+		}
+	}
+}
+
+static void gc_parallel(int threads) {
+	gc_marked = !gc_marked;
+
+	mark_roots();
+
+	MarkStack roots_marked = marks;
+	marks       = pool.shared;
+	pool.shared = roots_marked;
+	pool.idle    = 0;
+	pool.workers = threads;
+
+	gc_spawn(mark_worker, NULL, 0, threads, true);
+
+	int chunk_count = 0;
+	for(HeapChunk *chunk = heap_chunks; chunk; chunk = chunk->next) {
+		chunk_count++;
+	}
+
+	HeapChunk **chunks = malloc(sizeof(HeapChunk*) * (chunk_count + 1));
+	SweepWork  *work   = calloc(threads, sizeof(SweepWork));
+	if(!chunks || !work) {
+		printf("out of memory\n");
+		exit(1);
+	}
+
+	int c = 0;
+	for(HeapChunk *chunk = heap_chunks; chunk; chunk = chunk->next) {
+		chunks[c++] = chunk;
+	}
+
+	for(int t = 0; t < threads; t++) {
+		work[t].chunks      = chunks;
+		work[t].chunk_count = chunk_count;
+		work[t].first       = t;
+		work[t].step        = threads;
+	}
+
+	gc_spawn(sweep_worker, work, sizeof(SweepWork), threads, false);
+
+	for(int t = 0; t < threads; t++) {
+		heap_merge(&work[t].sweep);
+		allocs -= work[t].sweep.objects;
+	}
+
+	free(chunks);
+	free(work);
+
+	gc_end();
+}
+
+/*
+	after a whole collection the objects of mostly free chunks are 
+	moved together and every reference in the roots and the heap is 
+	pointed at the copies, then the emptied chunks are released
+*/
+
+static void compact_slots(Slot *slots, int size) {
+	for(int y = 0; y < size; y++) {
+		if(slots[y].is_ref && slots[y].ref->is_moved) {
+			slots[y].ref = OBJECT_LINK(slots[y].ref);
+		}
+	}
+}
+
+static void gc_compact() {
+	HeapChunk *evacuated = heap_evacuate(gc_compaction);
+	if(!evacuated) {
+		return;
+	}
+
+	for(int64_t vp = 0; vp <= roots.vp; vp += roots.locals[vp]) {
+		compact_slots(roots.stack + vp, roots.locals[vp]);
+	}
+	compact_slots(roots.stack + STACK_BASE, roots.sp - STACK_BASE);
+
+	for(HeapChunk *chunk = heap_chunks; chunk; chunk = chunk->next) {
+		for(char *block = HEAP_CHUNK_DATA(chunk); block < chunk->top; block += ((Object*)block)->block) {
+			Object *o = (Object*)block;
+			if(o->is_free) {
+				continue;
+			}
+
+			compact_slots(OBJECT_VARLIST(o), OBJECT_SLOTS(o));
+
+			if(o->has_refs) {
+				Object **elements = (Object**)OBJECT_ARRAY(o);
+				for(int y = 0; y < o->size / (int)sizeof(Object*); y++) {
+					if(elements[y] && elements[y]->is_moved) {
+						elements[y] = OBJECT_LINK(elements[y]);
+					}
+				}
+			}
+		}
+	}
+
+	heap_release(evacuated);
+}
+
+/* finishes a cycle in progress, then runs a whole new one */
+void gc() {
+	while(gc_phase != GC_IDLE) {
+		gc_run(INT64_MAX);
+	}
+
+	if(gc_threads > 1) {
+		gc_parallel(gc_threads > GC_MAX_THREADS ? GC_MAX_THREADS : gc_threads);
+	} else {
+		do {
+			gc_run(INT64_MAX);
+		} while(gc_phase != GC_IDLE);
+	}
+
+	if(gc_compaction > 0) {
+		gc_compact();
+	}
+}
+
+/*
+	pops a syscall name and its arguments, pushes the result and 
+	returns the new stack pointer
+*/
+
+int64_t runtime_syscall(Slot *stack, int64_t sp) {
+	int name = (int)POP_STACK();
+
+	if(name == 1) {
+		int64_t arg = POP_STACK();
+		printf("%li\n", arg);
+
+		PUSH_STACK(0);
+	} else if(name == 2000) {
+		Object *arg = POP_STACK_OBJECT();
+
+		for(int i = 0; i < 32; i++) {
+			printf("%02x\n", OBJECT_ARRAY(arg)[i] & 0xff);
+		}
+
+		PUSH_STACK(0);
+	} else if(name == 8000) {
+		Object  *dst        = POP_STACK_OBJECT();
+		int64_t  dst_offset = POP_STACK();
+		Object  *src        = POP_STACK_OBJECT();
+		int64_t  src_offset = POP_STACK();
+		int64_t  b          = POP_STACK();
+
+		memcpy(OBJECT_ARRAY(dst) + (dst_offset * src->type), OBJECT_ARRAY(src) + (src_offset * src->type), b * src->type);
+
+		/* elements copied into an array of objects are stores too */
+		if(dst->has_refs) {
+			Object **elements = (Object**)(OBJECT_ARRAY(dst) + (dst_offset * src->type));
+			for(int64_t i = 0; i < b * src->type / (int64_t)sizeof(Object*); i++) {
+				if(elements[i]) {
+					runtime_barrier(elements[i]);
+				}
+			}
+		}
+
+		PUSH_STACK(0);
+	} else if(name == 2) {
+		int64_t arg = POP_STACK();
+		printf("%c", (char)arg);
+
+		PUSH_STACK(0);
+	} else if(name == 5) {
+		Object *arg = POP_STACK_OBJECT();
+		free_object(arg);
+		PUSH_STACK(0);
+	} else if(name == 60) {
+		int sockfd = socket(AF_INET, SOCK_STREAM, 0);
+
+		setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &(int){1}, sizeof(int));
+
+		PUSH_STACK(sockfd);
+	} else if(name == 61) {
+		int64_t fd   = POP_STACK();
+		Object  *ip   = POP_STACK_OBJECT();
+		int64_t port = POP_STACK();
+		char ip_c[128];
+
+		strncpy(ip_c, OBJECT_ARRAY(ip), OBJECT_VARLIST(ip)[0].value);
+
+
+		struct sockaddr_in servaddr;
+		servaddr.sin_family = AF_INET;
+		servaddr.sin_addr.s_addr = inet_addr(ip_c);
+		servaddr.sin_port = htons((int)port);
+
+		int result = bind((int)fd, (struct sockaddr*)&servaddr, sizeof(servaddr));
+		listen((int)fd, 5);
+
+		PUSH_STACK(result == 0);
+	} 
+	else if(name == 62) {
+		int64_t fd = POP_STACK();
+
+		int newfd = accept((int)fd, NULL, 0);
+
+		PUSH_STACK(newfd);
+	} else if(name == 63) {
+		int64_t fd = POP_STACK();
+		Object *buffer = POP_STACK_OBJECT();
+		int64_t size = POP_STACK();
+
+		int r = read((int)fd, OBJECT_ARRAY(buffer), size);
+
+		PUSH_STACK(r);
+	} else if(name == 64) {
+		int64_t fd = POP_STACK();
+		Object *buffer = POP_STACK_OBJECT();
+		int64_t size = POP_STACK();
+
+		int w = write((int)fd, OBJECT_ARRAY(buffer), size);
+
+		PUSH_STACK(w);
+	} else if(name == 65) {
+		int64_t fd = POP_STACK();
+
+		close((int)fd);
+
+		PUSH_STACK(0);
+	} else if(name == 13) {
+		begin = clock();
+
+		PUSH_STACK(0);
+	} else if(name == 6969) {
+		exit(0);
+	} else if(name == 14) {
+		clock_t end = clock();
+		double time_spent = (double)(end - begin) / CLOCKS_PER_SEC;
+		printf("%f\n", time_spent);
+
+		PUSH_STACK(0);
+	} else if(name == 33) {
+		PUSH_STACK(rand());
+	} else if(name == 49935) {
+		double  number = POP_STACK_DOUBLE();
+		Object *buffer    = POP_STACK_OBJECT();
+		int length = sprintf(OBJECT_ARRAY(buffer), "%f", number);
+		PUSH_STACK(length);
+	} else if(name == 34569) {
+		Object *buffer = POP_STACK_OBJECT();
+		int64_t size = POP_STACK();
+
+		int r = read(STDIN_FILENO, OBJECT_ARRAY(buffer), size);
+
+		PUSH_STACK(r - 1);
+	} else if(name == 34555) {
+		gc();
+		PUSH_STACK(0);
+	} else if(name == 34556) {
+		int64_t field = POP_STACK();
+		int64_t stat  = 0;
+
+		switch(field) {
+			case GC_STAT_IN_USE: {
+				stat = heap_in_use;
+			}
+			break;
+			case GC_STAT_ALLOCATED: {
+				stat = gc_allocated;
+			}
+			break;
+			case GC_STAT_THRESHOLD: {
+				stat = gc_threshold;
+			}
+			break;
+			case GC_STAT_COLLECTIONS: {
+				stat = gc_collections;
+			}
+			break;
+			case GC_STAT_OBJECTS: {
+				stat = allocs;
+			}
+			break;
+		}
+
+		PUSH_STACK(stat);
+	} else if(name == 34557) {
+		int64_t knob  = POP_STACK();
+		int64_t value = POP_STACK();
+		int64_t old   = 0;
+
+		if(knob == GC_SET_PAUSE) {
+			old      = gc_pause;
+			gc_pause = value;
+		} else if(knob == GC_SET_CAP) {
+			old    = gc_cap;
+			gc_cap = value;
+		} else if(knob == GC_SET_STEP) {
+			old          = gc_step_size;
+			gc_step_size = value;
+		} else if(knob == GC_SET_THREADS) {
+			old        = gc_threads;
+			gc_threads = value;
+		} else if(knob == GC_SET_COMPACT) {
+			old           = gc_compaction;
+			gc_compaction = value;
+		}
+
+		PUSH_STACK(old);
+	} else {
+		printf("unknown syscall %i\n", name);
+		exit(1);
+	}
+
+	return sp;
+}
@@ -0,0 +1,278 @@
+#ifndef RUNTIME_H
+#define RUNTIME_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "intepreter.h"
+
+/*
+	a collection starts once the bytes allocated since the last one 
+	pass the threshold. the threshold is then pause percent of the 
+	bytes still in use, at least GC_MIN_THRESHOLD and at most the cap. 
+	pause 0 turns automatic collection off. with a step the cycle is 
+	incremental, every allocation then marks about step slots or 
+	sweeps about step blocks. all are tunable with syscall 34557 (see 
+	libchip/GC.chip)
+*/
+
+#define GC_PAUSE 100
+#define GC_CAP (256 * 1024 * 1024)
+#define GC_MIN_THRESHOLD (1024 * 1024)
+#define GC_STEP 0
+
+/* threads of a whole collection, markers share work in batches */
+#define GC_THREADS 1
+#define GC_MAX_THREADS 64
+#define GC_MARK_BATCH 64
+
+/* whole collections empty chunks at most this many percent full */
+#define GC_COMPACT 25
+
+/* bytes of the region arrays that stay in their frame come from */
+#define LOCAL_SIZE (16 * 1024 * 1024)
+
+enum {
+	GC_IDLE,
+	GC_MARKING,
+	GC_SWEEPING
+};
+
+/* fields of syscall 34556 */
+enum {
+	GC_STAT_IN_USE,
+	GC_STAT_ALLOCATED,
+	GC_STAT_THRESHOLD,
+	GC_STAT_COLLECTIONS,
+	GC_STAT_OBJECTS
+};
+
+/* knobs of syscall 34557 */
+enum {
+	GC_SET_PAUSE,
+	GC_SET_CAP,
+	GC_SET_STEP,
+	GC_SET_THREADS,
+	GC_SET_COMPACT
+};
+
+/*
+	what a collection marks from: each frame up to vp and the oprand 
+	stack up to sp. locals holds the size of the frame starting at 
+	each slot, the next frame starts right after it. eval() and 
+	compiled programs store vp and sp before every op that allocates
+*/
+
+typedef struct {
+	Slot    *stack;
+	int64_t  vp;
+	int64_t  sp;
+	int     *locals;
+} Roots;
+
+extern Roots roots;
+extern int   gc_phase;
+
+/*
+	arrays that never leave the method allocating them (see escape.c) 
+	are taken from local_top up, a call saves local_top and its return 
+	puts it back, which frees them all at once
+*/
+
+extern char *local_top;
+extern char *local_end;
+
+/*
+	string constants are arrays in the constant pool, outside of the 
+	heap so the collector never sees them. a load the compiler proved 
+	is only ever read pushes the array itself (see escape.c), any other 
+	load gets a copy of it
+*/
+
+extern Object **constant_objects;
+
+#define SYNC_ROOTS() (roots.vp = vp, roots.sp = sp)
+
+int               syscall_argc(int name);
+Slot             *runtime_stack();
+void              runtime_constants(char *pool, int64_t count);
+Object           *new_object(int size);
+Object           *new_array(int64_t count, int type);
+void              free_object(Object *object);
+void              gc();
+void              gc_run(int64_t budget);
+void              gc_shade(Object *o);
+int64_t           runtime_syscall(Slot *stack, int64_t sp);
+
+/*
+	ops that touch object memory, inlined into eval() and into the
+	code chip aot generates so both behave the same
+*/
+
+/*
+	a new frame starts with stale slots of an earlier call, they must 
+	not keep anything alive
+*/
+
+static inline void runtime_enter(Slot *stack, int64_t vp, int locals) {
+	roots.locals[vp] = locals;
+
+	for(int i = 0; i < locals; i++) {
+		stack[vp + i].is_ref = false;
+	}
+}
+
+/*
+	a call moves the instance and the arguments from the oprand stack 
+	straight into the first slots of the new frame at vp, the 
+	arguments were pushed last to first. returns the new sp
+*/
+
+static inline int64_t runtime_call(Slot *stack, int64_t vp, int64_t sp, int args, int locals) {
+	runtime_enter(stack, vp, locals);
+
+	sp -= args;
+
+	stack[vp] = stack[sp];
+	stack[sp].is_ref = false;
+
+	for(int i = 1; i < args; i++) {
+		stack[vp + i] = stack[sp + args - i];
+		stack[sp + args - i].is_ref = false;
+	}
+
+	return sp;
+}
+
+/*
+	a reference stored into the heap while marking is shaded, so no 
+	black object ever points to a white one
+*/
+
+static inline void runtime_barrier(Object *o) {
+	if(gc_phase == GC_MARKING) {
+		gc_shade(o);
+	}
+}
+
+static inline void runtime_store_field(Object *instance, int64_t field, Slot var) {
+	OBJECT_VARLIST(instance)[field] = var;
+
+	if(var.is_ref) {
+		runtime_barrier(var.ref);
+	}
+}
+
+static inline Object *runtime_load_const(int64_t index) {
+	Object *constant = constant_objects[index];
+	Object *o        = new_array(constant->size, sizeof(char));
+
+	memcpy(OBJECT_ARRAY(o), OBJECT_ARRAY(constant), constant->size);
+
+	OBJECT_VARLIST(o)[0].value = OBJECT_VARLIST(constant)[0].value;
+
+	return o;
+}
+
+static inline Object *runtime_new_array(int64_t count, int8_t type) {
+	Object *instance = new_array(count, type);
+
+	memset(OBJECT_ARRAY(instance), 0, count * type);
+
+	return instance;
+}
+
+/*
+	an array from the frame region is pushed as no reference, the 
+	collector never sees it and nothing it holds needs marking. one 
+	that does not fit comes from the heap as usual
+*/
+
+static inline Slot runtime_new_local_array(int64_t count, int8_t type) {
+	size_t block = (sizeof(Object) + sizeof(Slot) + count * type + 15) & ~(size_t)15;
+
+	if(count < 0 || block > (size_t)(local_end - local_top)) {
+		return (Slot){ .is_ref = true, .ref = runtime_new_array(count, type) };
+	}
+
+	Object *o = (Object*)local_top;
+	local_top += block;
+
+	o->block     = block;
+	o->size      = count * type;
+	o->type      = type;
+	o->is_array  = true;
+	o->is_marked = false;
+	o->is_free   = false;
+	o->has_refs  = false;
+	o->is_moved  = false;
+
+	OBJECT_VARLIST(o)[0].is_ref = false;
+	OBJECT_VARLIST(o)[0].value  = count;
+
+	memset(OBJECT_ARRAY(o), 0, count * type);
+
+	return (Slot){ .is_ref = false, .ref = o };
+}
+
+/*
+	array ops come in one form per element width and take the element 
+	index, the unsigned compare also catches a negative one. 8 byte 
+	elements of a has_refs array are references. the _unchecked forms 
+	are for accesses the compiler proved in bounds (see bounds.c)
+*/
+
+static inline void runtime_check_index(Object *instance, int64_t index, int width, const char *access) {
+	if((uint64_t)index >= (uint64_t)(instance->size / width)) {
+		printf("array out of bound access %s error %li %i\n", access, index, instance->size / width - 1);
+		exit(1);
+	}
+}
+
+static inline int64_t runtime_load_i8_unchecked(Object *instance, int64_t index) {
+	return (uint8_t)OBJECT_ARRAY(instance)[index];
+}
+
+static inline Slot runtime_load_i64_unchecked(Object *instance, int64_t index) {
+	int64_t item = ((int64_t*)OBJECT_ARRAY(instance))[index];
+
+	return (Slot){ .is_ref = instance->has_refs && item, .value = item };
+}
+
+static inline void runtime_store_i8_unchecked(Object *instance, int64_t index, int64_t value) {
+	OBJECT_ARRAY(instance)[index] = (char)value;
+}
+
+static inline void runtime_store_i64_unchecked(Object *instance, int64_t index, int64_t value) {
+	((int64_t*)OBJECT_ARRAY(instance))[index] = value;
+
+	if(instance->has_refs && value) {
+		runtime_barrier((Object*)value);
+	}
+}
+
+static inline int64_t runtime_load_i8(Object *instance, int64_t index) {
+	runtime_check_index(instance, index, 1, "read");
+
+	return runtime_load_i8_unchecked(instance, index);
+}
+
+static inline Slot runtime_load_i64(Object *instance, int64_t index) {
+	runtime_check_index(instance, index, 8, "read");
+
+	return runtime_load_i64_unchecked(instance, index);
+}
+
+static inline void runtime_store_i8(Object *instance, int64_t index, int64_t value) {
+	runtime_check_index(instance, index, 1, "write");
+
+	runtime_store_i8_unchecked(instance, index, value);
+}
+
+static inline void runtime_store_i64(Object *instance, int64_t index, int64_t value) {
+	runtime_check_index(instance, index, 8, "write");
+
+	runtime_store_i64_unchecked(instance, index, value);
+}
+
+#endif
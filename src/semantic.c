@@ -133,6 +133,7 @@ void semantic_class(Node *node) {
 				varscope_push();
 				varscope_add("this", ty);
 				semantic_method(entry);
+				entry->method->locals = varscope_high();
 				varscope_pop();
 			}
 			break;
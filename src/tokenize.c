@@ -44,9 +44,10 @@ static Token *new_token(TokenType type, char *data, int length, int line) {
 	}
 
 	char *t = sb_concat(sb);
-	sb_free(sb);
 
 	token->data = t;
+	token->length = sb->length;
+	sb_free(sb);
 	token->type = type;
 	token->line = line;
 
@@ -17,6 +17,7 @@ typedef struct _Token {
 	ListNode node;
 	TokenType type;
 	char *data;
+	int length;
 	int line;
 } Token;
 
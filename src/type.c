@@ -106,6 +106,7 @@ TyMethod *insert_method(Ty *class, char *name, char *signature, Ty *type) {
 	method->type = type;
 	method->name = strdup(name);
 	method->signature = strdup(signature);
+	method->locals = 0;
 
 	list_insert(list_end(&class->methods), method);
 	return method;
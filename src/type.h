@@ -24,6 +24,7 @@ typedef struct {
 	Ty *type;
 	char *name;
 	char *signature;
+	int locals; // frame slots, this and the parameters included
 } TyMethod;
 
 void                 type_clear();
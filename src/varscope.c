@@ -7,6 +7,9 @@
 List varscope[8192];
 int sp = 0;
 
+/* most variables in scope at once since varscope_high() was last called */
+static int high = 0;
+
 void varscope_clear() {
 	for(int i = 0; i < 8192; i++) {
 		list_clear(&varscope[i]);
@@ -37,11 +40,21 @@ Var *varscope_add(char *name, Ty *type) {
 	var->type = type;
 	var->offset = varscope_size();
 
+	if(var->offset + 1 > high) {
+		high = var->offset + 1;
+	}
+
 	list_insert(list_end(&varscope[sp]), var);
 
 	return var;
 }
 
+int varscope_high() {
+	int size = high;
+	high = 0;
+	return size;
+}
+
 Var *varscope_get(char *name) {
 	for(int i = 0; i <= sp; i++) {
 		for(ListNode *v = list_begin(&varscope[i]); v != list_end(&varscope[i]); v = list_next(v)) {
@@ -14,6 +14,7 @@ void                 varscope_clear();
 void                 varscope_push();
 void                 varscope_pop();
 int                  varscope_size();
+int                  varscope_high();
 Var *                varscope_add(char *name, Ty *type);
 Var                 *varscope_get(char *name);
 
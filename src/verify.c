@@ -0,0 +1,263 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include "chip.h"
+#include "verify.h"
+#include "runtime.h"
+
+/*
+	Chip bytecode verifier
+
+	walks every method once at load time and computes how deep its 
+	oprand stack can grow, so the intepreter only has to check for 
+	overflow when a frame is pushed, and checks that no op reaches 
+	past the frame its calls declare, frames are laid out back to back
+*/
+
+/*
+	syscall takes its name from the push right before it, a call 
+	carries its argument count and the frame size of the method
+*/
+
+int verify_push_value(Instruction *codes, int i) {
+	if(i < 0) {
+		return -1;
+	}
+
+	Instruction *ins = &codes[i];
+
+	if(ins->op == OP_PUSH) {
+		return (int)ins->left;
+	}
+	if(ins->op >= OP_PUSH_0 && ins->op <= OP_PUSH_5) {
+		return ins->op - OP_PUSH_0;
+	}
+	return -1;
+}
+
+/*
+	frame slots an op addresses must stay inside the frame the calls 
+	of its method declare
+*/
+
+static bool verify_slots(Instruction *ins, int locals) {
+	switch(ins->op) {
+		case OP_LOAD:
+		case OP_STORE: {
+			return ins->left >= 0 && ins->left < locals;
+		}
+		break;
+		case OP_MOV: {
+			return ins->left >= 0 && ins->left < locals && ins->dest < locals;
+		}
+		break;
+		case OP_MOVI: {
+			return ins->dest < locals;
+		}
+		break;
+		case OP_INC_LOCAL:
+		case OP_JZ_LOCAL: {
+			return ins->right >= 0 && ins->right < locals;
+		}
+		break;
+	}
+
+	if(ins->op >= OP_LOAD_0 && ins->op <= OP_LOAD_5) {
+		return ins->op - OP_LOAD_0 < locals;
+	}
+	if(ins->op >= OP_STORE_0 && ins->op <= OP_STORE_5) {
+		return ins->op - OP_STORE_0 < locals;
+	}
+
+	if(ins->op >= OP_ADD_RR && ins->op <= OP_CMPLT_RI) {
+		bool immediate = (ins->op - OP_ADD_RR) % 2 == 1;
+		if(!immediate && (ins->left < 0 || ins->left >= locals)) {
+			return false;
+		}
+		return ins->right >= 0 && ins->right < locals && ins->dest < locals;
+	}
+
+	return true;
+}
+
+static int verify_method(Instruction *codes, int code_size, Method *methods, Method *method, int *depth, int *worklist) {
+	/* this and the arguments arrive in frame slots, not on the oprand stack */
+	int base = 0;
+	int max  = base;
+	int top  = 0;
+
+	depth[method->entry] = base;
+	worklist[top++] = method->entry;
+
+	while(top > 0) {
+		int i = worklist[--top];
+		int d = depth[i];
+
+		Instruction *ins = &codes[i];
+
+		if(!verify_slots(ins, method->locals)) {
+			printf("verify error: frame slot out of range at %i\n", i);
+			exit(1);
+		}
+
+		int pops   = op_pops[ins->op];
+		int pushes = op_pushes[ins->op];
+
+		if(ins->op == OP_CALL) {
+			pops   = methods[ins->right].arg_count + 1;
+			pushes = 1;
+		}
+
+		if(ins->op == OP_SYSCALL) {
+			int argc = syscall_argc(verify_push_value(codes, i - 1));
+			if(argc < 0) {
+				printf("verify error: unknown syscall at %i\n", i);
+				exit(1);
+			}
+			pops   = argc + 1;
+			pushes = 1;
+		}
+
+		if(d < pops) {
+			printf("verify error: stack underflow at %i\n", i);
+			exit(1);
+		}
+
+		int next = d - pops + pushes;
+		if(next > max) {
+			max = next;
+		}
+
+		if(ins->op == OP_RET && d != 1) {
+			printf("verify error: unbalanced stack on return at %i\n", i);
+			exit(1);
+		}
+
+		int targets[2];
+		int target_count = 0;
+
+		switch(ins->op) {
+			case OP_JMP: {
+				targets[target_count++] = ins->left;
+			}
+			break;
+			case OP_JE:
+			case OP_JZ:
+			case OP_JZ_LOCAL:
+			case OP_CMPEQ_JZ:
+			case OP_CMPGT_JZ:
+			case OP_CMPLT_JZ: {
+				targets[target_count++] = ins->left;
+				targets[target_count++] = i + 1;
+			}
+			break;
+			case OP_RET:
+			case OP_HALT: {
+
+			}
+			break;
+			default: {
+				targets[target_count++] = i + 1;
+			}
+			break;
+		}
+
+		for(int t = 0; t < target_count; t++) {
+			int target = targets[t];
+
+			if(target >= code_size) {
+				printf("verify error: control falls off the end of the code at %i\n", i);
+				exit(1);
+			}
+
+			if(depth[target] == -1) {
+				depth[target] = next;
+				worklist[top++] = target;
+			} else if(depth[target] != next) {
+				printf("verify error: inconsistent stack depth at %i (%i, %i)\n", target, depth[target], next);
+				exit(1);
+			}
+		}
+	}
+
+	return max;
+}
+
+Method *verify(Instruction *codes, int code_size, int entry, int *method_count) {
+	int *method_of = malloc(sizeof(int) * code_size);
+	int *depth     = malloc(sizeof(int) * code_size);
+	int *worklist  = malloc(sizeof(int) * code_size);
+
+	for(int i = 0; i < code_size; i++) {
+		method_of[i] = -1;
+		depth[i] = -1;
+	}
+
+	/* every call target starts a method, the entry point is the bootstrap */
+	int count = 1;
+	for(int i = 0; i < code_size; i++) {
+		if(codes[i].op == OP_CALL && method_of[codes[i].left] == -1) {
+			method_of[codes[i].left] = count++;
+		}
+	}
+
+	Method *methods = malloc(sizeof(Method) * count);
+
+	methods[0].entry     = entry;
+	methods[0].arg_count = -1;
+	methods[0].max_stack = 0;
+	methods[0].locals    = 1;
+
+	for(int i = 0; i < code_size; i++) {
+		if(method_of[i] > 0) {
+			methods[method_of[i]].entry     = i;
+			methods[method_of[i]].arg_count = -2;
+			methods[method_of[i]].max_stack = 0;
+			methods[method_of[i]].locals    = 0;
+		}
+	}
+
+	for(int i = 0; i < code_size; i++) {
+		if(codes[i].op != OP_CALL) {
+			continue;
+		}
+
+		int arg_count = codes[i].right;
+		if(arg_count < 0) {
+			printf("verify error: call without argument count at %i\n", i);
+			exit(1);
+		}
+
+		Method *method = &methods[method_of[codes[i].left]];
+		if(method->arg_count != -2 && method->arg_count != arg_count) {
+			printf("verify error: method at %i called with %i and %i arguments\n", method->entry, method->arg_count, arg_count);
+			exit(1);
+		}
+		method->arg_count = arg_count;
+
+		/* this and the arguments are the first slots of the frame */
+		int locals = codes[i].dest;
+		if(locals < arg_count + 1) {
+			printf("verify error: frame of %i slots too small for %i arguments at %i\n", locals, arg_count, i);
+			exit(1);
+		}
+		if(method->locals != 0 && method->locals != locals) {
+			printf("verify error: method at %i called with frames of %i and %i slots\n", method->entry, method->locals, locals);
+			exit(1);
+		}
+		method->locals = locals;
+
+		codes[i].right = method_of[codes[i].left];
+	}
+
+	for(int m = 0; m < count; m++) {
+		methods[m].max_stack = verify_method(codes, code_size, methods, &methods[m], depth, worklist);
+	}
+
+	free(method_of);
+	free(depth);
+	free(worklist);
+
+	*method_count = count;
+
+	return methods;
+}
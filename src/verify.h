@@ -0,0 +1,16 @@
+#ifndef VERIFY_H
+#define VERIFY_H
+
+#include "intepreter.h"
+
+typedef struct {
+	int entry;
+	int arg_count;
+	int max_stack;
+	int locals;
+} Method;
+
+int               verify_push_value(Instruction *codes, int i);
+Method           *verify(Instruction *codes, int code_size, int entry, int *method_count);
+
+#endif